@@ -207,6 +207,70 @@ ITBDEF enum itb_uri_type itb_uri_parse(itb_uri_t *uri, const char *s);
 ITBDEF void itb_uri_print(itb_uri_t *uri);
 ITBDEF void itb_uri_close(itb_uri_t *uri);
 
+//offset and length into the string that was parsed
+typedef struct {
+    size_t off;
+    size_t len;
+} itb_uri_span_t;
+
+//non owning version of itb_uri_t, nothing is copied or allocated
+//absent parts have a len of 0, use the returned type to tell them from empty ones
+typedef struct {
+    const char *base;
+    itb_uri_span_t prefix;
+    itb_uri_span_t host;
+    itb_uri_span_t suffix;
+} itb_uri_view_t;
+
+//single pass over s, s does not need to be '\0' terminated
+ITBDEF enum itb_uri_type itb_uri_view_parse(itb_uri_view_t *view, const char *s, size_t len);
+//pointer to the start of a span in the viewed string
+#define ITB_URI_VIEW_PTR(view, span) ((view)->base + (view)->span.off)
+
+//full rfc 3986 split, also non owning
+//delimiters are not part of any span, ip literals have their [] removed
+#define ITB_URI_HAS_SCHEME (1 << 0)
+#define ITB_URI_HAS_AUTHORITY (1 << 1)
+#define ITB_URI_HAS_USERINFO (1 << 2)
+#define ITB_URI_HAS_QUERY (1 << 3)
+#define ITB_URI_HAS_FRAGMENT (1 << 4)
+#define ITB_URI_HOST_IP_LITERAL (1 << 5)
+
+typedef struct {
+    const char *base;
+    itb_uri_span_t scheme;
+    itb_uri_span_t userinfo;
+    itb_uri_span_t host;
+    itb_uri_span_t path;
+    itb_uri_span_t query;
+    itb_uri_span_t fragment;
+    //-1 when there is no port or it was empty
+    int32_t port;
+    uint32_t flags;
+} itb_uri_parts_t;
+
+//0 on success, -1 if s is not a valid uri reference
+//delimiters are found 32 or 16 bytes at a time with AVX2 or SSE2 when the compiler targets them
+//define ITB_NO_SIMD to force the scalar version
+ITBDEF int itb_uri_parse_parts(itb_uri_parts_t *parts, const char *s, size_t len);
+
+//in place normalization, all of these only ever shrink the string and return the new len
+//when there is nothing to do they cost a single SIMD scan
+//decode every valid %XX
+ITBDEF size_t itb_uri_pct_decode(char *s, size_t len);
+//ascii only lower casing
+ITBDEF void itb_uri_lower(char *s, size_t len);
+//rfc 3986 5.2.4
+ITBDEF size_t itb_uri_remove_dot_segments(char *s, size_t len);
+//rfc 3986 6.2.2 syntax based normalization of the string parts was parsed from
+//lowercases scheme and host, decodes escaped unreserved characters and uppercases the rest,
+//removes dot segments and leading zeros in the port
+//the parts are rewritten to match the compacted string so it can be used as a cache key
+ITBDEF size_t itb_uri_normalize_parts(char *s, itb_uri_parts_t *parts);
+//same normalization for the prefix and host of an already parsed itb_uri_t
+//host also holds the path so only the part before the first '/', '?' or '#' is lower cased
+ITBDEF void itb_uri_normalize(itb_uri_t *uri);
+
 //==>basic menu<==
 typedef enum itb_menu_item_type_t {
     LABEL, //text only
@@ -237,11 +301,18 @@ typedef struct itb_menu_item_t {
 
 typedef struct itb_menu_t {
     bool free_on_close;
+    //built by itb_menu_builder_finish, the whole tree is one block owned by the root
+    bool arena;
     //name of the menu
     char *header;
     //how many and which items
     size_t total_items;
+    size_t alloc_items;
     itb_menu_item_t **items;
+    //items index for each numbered entry so labels dont need skipping,
+    //shares the allocation with items
+    size_t total_selectable;
+    size_t *selectable;
     //either previous or jump to pointer
     struct itb_menu_t *stacked;
 } itb_menu_t;
@@ -267,6 +338,48 @@ ITBDEF itb_menu_item_t *itb_menu_item_callback_ex(const char *text, void (*callb
 ITBDEF itb_menu_item_t *itb_menu_item_menu(const char *text, itb_menu_t *menu);
 ITBDEF itb_menu_item_t *itb_menu_item_toggle(const char *text, bool *flag);
 
+//lays out a whole menu tree, headers and labels included, in a single allocation
+//menus are referred to by the id itb_menu_builder_menu returns, 0 is the root
+//strings are only copied by finish so they must stay valid until then
+typedef struct {
+    itb_menu_item_type_t type;
+    int menu;
+    const char *text;
+    union {
+        struct itb_callback_item callback;
+        int menu;
+        bool *toggle;
+    } extra;
+} itb_menu_builder_item_t;
+
+typedef struct {
+    const char **headers;
+    size_t total_menus;
+    size_t alloc_menus;
+    itb_menu_builder_item_t *items;
+    size_t total_items;
+    size_t alloc_items;
+    size_t total_callbacks;
+    size_t string_size;
+} itb_menu_builder_t;
+
+ITBDEF void itb_menu_builder_init(itb_menu_builder_t *builder);
+//frees the description, menus from finish stay valid
+ITBDEF void itb_menu_builder_close(itb_menu_builder_t *builder);
+//returns the menu id or -1
+ITBDEF int itb_menu_builder_menu(itb_menu_builder_t *builder, const char *header);
+//all return 0 or -1
+ITBDEF int itb_menu_builder_label(itb_menu_builder_t *builder, int menu, const char *text);
+ITBDEF int itb_menu_builder_callback(
+    itb_menu_builder_t *builder, int menu, const char *text, void (*callback)(void *), void *data);
+ITBDEF int itb_menu_builder_submenu(
+    itb_menu_builder_t *builder, int menu, const char *text, int submenu);
+ITBDEF int itb_menu_builder_toggle(
+    itb_menu_builder_t *builder, int menu, const char *text, bool *flag);
+//returns the root menu or NULL, itb_menu_close on the root frees the whole tree
+//items cant be registered on built menus
+ITBDEF itb_menu_t *itb_menu_builder_finish(itb_menu_builder_t *builder);
+
 //display current menu position
 ITBDEF void itb_menu_print(const itb_menu_t *menu);
 //handle print and input loop, only good for single threaded
@@ -275,14 +388,279 @@ ITBDEF void itb_menu_run(const itb_menu_t *menu);
 //-1 invalid, 0 fine, 1 exit
 ITBDEF int itb_menu_run_once(itb_menu_t *menu, const char *line);
 
-//- errno on error or len of total read
-// will clear trailing input on read, terminates with '\0' not '\n'
+//- errno on error, 0 if nothing is ready yet, or the length of the line plus the '\0'
+//lines are read through a buffered stdin reader so piped input is never lost,
+//anything past len - 1 is dropped, terminates with '\0' not '\n', -EINVAL when len is 0
 ITBDEF ssize_t itb_readline(uint8_t *buffer, size_t len);
 
+//==>line reader<==
+//buffered line reader for any fd, each read is split into as many lines as it holds
+#ifndef ITB_LINEREADER_SIZE
+#define ITB_LINEREADER_SIZE 4096
+#endif
+
+typedef struct {
+    int fd;
+    uint8_t *buffer;
+    //unconsumed data is [start, end), scan is where the newline search picks back up
+    size_t start;
+    size_t scan;
+    size_t end;
+    size_t alloc;
+    bool eof;
+    //the last line was cut at the buffer size and the rest follows as the next line
+    bool partial;
+    //owned buffers grow to fit long lines, caller buffers hand them out in pieces
+    bool free_on_close;
+} itb_linereader_t;
+
+//size of 0 uses ITB_LINEREADER_SIZE, sets free_on_close to true
+ITBDEF int itb_linereader_init(itb_linereader_t *lr, int fd, size_t size);
+ITBDEF void itb_linereader_init_with(itb_linereader_t *lr, int fd, void *mem, size_t size);
+ITBDEF void itb_linereader_close(itb_linereader_t *lr);
+//points line at the next '\0' terminated line without the '\n' and returns its length
+//line is only valid until the next call, a last line without a '\n' is still returned
+//0 with line set to NULL when a non blocking fd has no full line yet or on eof (lr->eof)
+//- errno on error
+ITBDEF ssize_t itb_linereader_next(itb_linereader_t *lr, char **line);
+
+//==>file lines<==
+//zero copy line views over whole files, regular files are mapped and anything else
+//goes through an itb_linereader_t with big reads
+#ifndef ITB_LINES_READ_SIZE
+#define ITB_LINES_READ_SIZE (1024 * 1024)
+#endif
+
+typedef struct {
+    //not '\0' terminated for mapped files, the '\n' is not included but a '\r' before it is
+    const char *ptr;
+    size_t len;
+} itb_line_t;
+
+typedef struct {
+    //mapped file or caller memory
+    const char *data;
+    size_t size;
+    size_t pos;
+    //used when the fd cant be mapped
+    itb_linereader_t reader;
+    int fd;
+    bool mapped;
+    bool buffered;
+    //set by itb_lines_open so the fd is closed with the reader
+    bool free_on_close;
+} itb_lines_t;
+
+//all return 0 or -1
+ITBDEF int itb_lines_open(itb_lines_t *lines, const char *path);
+ITBDEF int itb_lines_open_fd(itb_lines_t *lines, int fd);
+//view over memory that is already loaded, ie one chunk of itb_lines_parallel
+ITBDEF void itb_lines_init_mem(itb_lines_t *lines, const char *data, size_t size);
+ITBDEF void itb_lines_close(itb_lines_t *lines);
+//1 and line is filled in, 0 at the end, - errno on error
+ITBDEF int itb_lines_next(itb_lines_t *lines, itb_line_t *line);
+//splits whats left into newline aligned chunks, one per thread, and waits for them all
+//each call gets a reader over its chunk, only works on mapped files or memory views
+//returns 0 or -1
+ITBDEF int itb_lines_parallel(itb_lines_t *lines, size_t threads,
+    void (*func)(itb_lines_t *chunk, size_t index, void *data), void *data);
+
+//==>number formatting<==
+//snprintf free kernels, they write without a '\0' and return the number of chars written
+//out must have room for the matching max
+#define ITB_FMT_INT_MAX 20
+#define ITB_FMT_HEX_MAX 16
+#define ITB_FMT_FLOAT_MAX 64
+ITBDEF size_t itb_fmt_u64(char *out, uint64_t v);
+ITBDEF size_t itb_fmt_i64(char *out, int64_t v);
+ITBDEF size_t itb_fmt_hex(char *out, uint64_t v);
+//shortest digits that read back as the same float, always in positional notation
+//ie 16 -> "16.0", 0.1f -> "0.1", 1e-3f -> "0.001"
+ITBDEF size_t itb_fmt_float(char *out, float v);
+
 //==>QOL wrappers<==
+//supports %% %c %s %d %u %ld %lu %zu %x %p and %f, %f is printed with itb_fmt_float
+//output is cut off at exactly str_size and is not '\0' terminated
+//returns the number of chars written
 ITBDEF ssize_t itb_printf(
     char *str, size_t str_size, const char *format, size_t args_size, void **args);
 
+//reusable format plans so the format string is only scanned once
+typedef enum {
+    ITB_PF_LITERAL,
+    ITB_PF_CHAR, //%c char *
+    ITB_PF_STRING, //%s char *
+    ITB_PF_INT, //%d int *
+    ITB_PF_FLOAT, //%f float *
+    ITB_PF_UINT, //%u unsigned *
+    ITB_PF_LONG, //%ld long *
+    ITB_PF_ULONG, //%lu unsigned long *
+    ITB_PF_SIZE, //%zu size_t *
+    ITB_PF_HEX, //%x unsigned *
+    ITB_PF_PTR //%p the arg itself
+} itb_printf_op_type_t;
+
+typedef struct {
+    itb_printf_op_type_t type;
+    //literal text, for compiled plans this points into the format string
+    const char *lit;
+    size_t len;
+} itb_printf_op_t;
+
+typedef struct {
+    const itb_printf_op_t *ops;
+    size_t total_ops;
+    bool free_on_close;
+} itb_printf_plan_t;
+
+//the format must outlive the plan as literals are not copied
+//sets free_on_close to true
+ITBDEF int itb_printf_compile(itb_printf_plan_t *plan, const char *format);
+ITBDEF void itb_printf_close(itb_printf_plan_t *plan);
+//same output rules as itb_printf but args must hold one entry per conversion in the plan
+ITBDEF ssize_t itb_printf_exec(
+    const itb_printf_plan_t *plan, char *str, size_t str_size, void **args);
+
+//build plans at compile time out of string literals, ie for "x: %d\n"
+//static const itb_printf_op_t ops[] = {ITB_PF_LIT("x: "), ITB_PF_ARG(ITB_PF_INT), ITB_PF_LIT("\n")};
+//static const itb_printf_plan_t plan = ITB_PRINTF_PLAN(ops);
+#define ITB_PF_LIT(s) \
+    { ITB_PF_LITERAL, (s), sizeof(s) - 1 }
+#define ITB_PF_ARG(type) \
+    { (type), NULL, 0 }
+#define ITB_PRINTF_PLAN(ops) \
+    { (ops), sizeof(ops) / sizeof((ops)[0]), false }
+
+//==>string builder<==
+#ifndef ITB_STRBUF_INITIAL_SIZE
+#define ITB_STRBUF_INITIAL_SIZE 64
+#endif
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t alloc;
+    //data belongs to the caller until the first growth moves it to the heap
+    bool external;
+} itb_strbuf_t;
+
+ITBDEF int itb_strbuf_init(itb_strbuf_t *sb, size_t size);
+//back the builder with memory the caller owns, ie a stack buffer or an arena block
+ITBDEF void itb_strbuf_init_with(itb_strbuf_t *sb, void *mem, size_t size);
+ITBDEF void itb_strbuf_close(itb_strbuf_t *sb);
+//drop the contents but keep the memory for the next message
+#define itb_strbuf_clear(sb) ((sb)->len = 0)
+
+//growth is amortized using ITB_VECTOR_ENLARGE, all return 0 or -1 when out of memory
+ITBDEF int itb_strbuf_reserve(itb_strbuf_t *sb, size_t extra);
+ITBDEF int itb_strbuf_append(itb_strbuf_t *sb, const char *s, size_t len);
+ITBDEF int itb_strbuf_append_str(itb_strbuf_t *sb, const char *s);
+ITBDEF int itb_strbuf_append_char(itb_strbuf_t *sb, char c);
+ITBDEF int itb_strbuf_append_i64(itb_strbuf_t *sb, int64_t v);
+ITBDEF int itb_strbuf_append_u64(itb_strbuf_t *sb, uint64_t v);
+ITBDEF int itb_strbuf_append_hex(itb_strbuf_t *sb, uint64_t v);
+ITBDEF int itb_strbuf_append_float(itb_strbuf_t *sb, float v);
+//itb_net.h adds itb_strbuf_append_addr when it is included after this
+
+//like itb_printf but grows instead of truncating
+ITBDEF int itb_strbuf_printf(itb_strbuf_t *sb, const char *format, size_t args_size, void **args);
+ITBDEF int itb_strbuf_printf_exec(itb_strbuf_t *sb, const itb_printf_plan_t *plan, void **args);
+//'\0' terminates the contents without counting it in len
+ITBDEF char *itb_strbuf_cstr(itb_strbuf_t *sb);
+
+//==>menu sessions<==
+//event driven menus, input bytes go in and everything that would be printed lands in out
+//so any number of sessions can share one thread, ie an operator console on a unix socket
+
+//submenus deep
+#ifndef ITB_MENU_SESSION_DEPTH
+#define ITB_MENU_SESSION_DEPTH 16
+#endif
+
+//longest accepted input line
+#ifndef ITB_MENU_SESSION_LINE
+#define ITB_MENU_SESSION_LINE 64
+#endif
+
+typedef struct {
+    //stack[0] is the root, the top is whats on screen
+    itb_menu_t *stack[ITB_MENU_SESSION_DEPTH];
+    size_t depth;
+    //partial input line
+    char line[ITB_MENU_SESSION_LINE];
+    size_t line_len;
+    //the current line overflowed and is skipped up to its '\n'
+    bool discarding;
+    bool done;
+    //pending output, the owner sends it and clears it
+    itb_strbuf_t out;
+    //for the owner, ie the connection
+    void *data;
+} itb_menu_session_t;
+
+//what itb_menu_print shows, nested picks back instead of exit for the last entry
+ITBDEF int itb_menu_render(const itb_menu_t *menu, bool nested, itb_strbuf_t *out);
+//index into menu->items for a 1 based selection line, total_items for back/exit, -1 invalid
+ITBDEF ssize_t itb_menu_select(const itb_menu_t *menu, const char *line);
+
+//renders the root menu into out, 0 or -1
+ITBDEF int itb_menu_session_init(itb_menu_session_t *session, itb_menu_t *menu);
+ITBDEF void itb_menu_session_close(itb_menu_session_t *session);
+//handles every complete line in data, partial lines are kept for the next call
+//1 once the root menu was exited, 0 otherwise, -1 out of memory
+ITBDEF int itb_menu_session_feed(itb_menu_session_t *session, const char *data, size_t len);
+//the session a callback is running for, NULL outside of itb_menu_session_feed
+//callbacks can append their output to ->out
+ITBDEF itb_menu_session_t *itb_menu_session_current(void);
+
+//==>deferred logger<==
+//hot threads only copy a format id and the raw args into their own ring, a background thread
+//formats with the compiled plan and writes in batches
+
+//bytes per thread, must be a power of 2
+#ifndef ITB_LOG_RING_SIZE
+#define ITB_LOG_RING_SIZE (64 * 1024)
+#endif
+
+#ifndef ITB_LOG_MAX_FORMATS
+#define ITB_LOG_MAX_FORMATS 256
+#endif
+
+//conversions per format
+#ifndef ITB_LOG_MAX_ARGS
+#define ITB_LOG_MAX_ARGS 16
+#endif
+
+//how long the backend sleeps when every ring is empty
+#ifndef ITB_LOG_IDLE_US
+#define ITB_LOG_IDLE_US 1000
+#endif
+
+//output is written once this much is formatted or the rings run dry
+#ifndef ITB_LOG_BATCH_SIZE
+#define ITB_LOG_BATCH_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+    uint64_t written;
+    //messages that did not fit in their ring
+    uint64_t dropped;
+} itb_log_stats_t;
+
+//starts the backend thread writing to fd
+ITBDEF int itb_log_init(int fd);
+//drains everything logged so far and stops the backend, no thread may log after this
+ITBDEF void itb_log_close(void);
+//same conversions as itb_printf, the format must stay valid until itb_log_close
+//returns the id to log with or -1
+ITBDEF int itb_log_register(const char *format);
+//args follow the itb_printf rules, %s strings are copied so they can be reused right away
+//0 on success, -1 if the message was dropped because the ring is full
+ITBDEF int itb_log(int id, void **args);
+//blocks until everything logged before the call has been written
+ITBDEF void itb_log_flush(void);
+ITBDEF void itb_log_stats(itb_log_stats_t *stats);
+
 #endif //ITB_H
 
 #ifdef ITB_IMPLEMENTATION
@@ -293,10 +671,16 @@ ITBDEF ssize_t itb_printf(
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#if !defined(ITB_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+
 //for strfromf
 #define __STDC_WANT_IEC_60559_BFP_EXT__
 #include <stdlib.h>
@@ -595,94 +979,514 @@ int itb_vector_remove_at(itb_vector_t *vec, size_t pos) {
 }
 
 //==>uri helpers<==
-enum itb_uri_type itb_uri_parse(itb_uri_t *uri, const char *s) {
-    if (!(uri->len = strlen(s))) {
+enum itb_uri_type itb_uri_view_parse(itb_uri_view_t *view, const char *s, size_t len) {
+    memset(view, 0, sizeof(itb_uri_view_t));
+    view->base = s;
+
+    if (!len) {
         return ERROR;
     }
 
-    char *prefix_eh;
-    char *suffix_eh;
+    //same rules as itb_uri_parse: the prefix ends at the first "://"
+    //and the suffix starts after the last ':' that isnt part of it
+    bool has_prefix   = false;
+    size_t host_start = 0;
+    size_t colon      = len;
+
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] != ':') {
+            continue;
+        }
+        if (!has_prefix && i + 2 < len && s[i + 1] == '/' && s[i + 2] == '/') {
+            has_prefix       = true;
+            view->prefix.len = i;
+            host_start       = i + 3;
+            //any colon before this belongs to the prefix
+            colon = len;
+            i += 2;
+        } else {
+            colon = i;
+        }
+    }
 
-    prefix_eh = strstr(s, "://");
-    suffix_eh = strrchr(s, ':');
+    view->host.off = host_start;
+    if (colon != len) {
+        view->host.len   = colon - host_start;
+        view->suffix.off = colon + 1;
+        view->suffix.len = len - colon - 1;
+        return has_prefix ? PREFIX_HOST_SUFFIX : HOST_SUFFIX;
+    }
 
-    enum itb_uri_type type;
+    view->host.len = len - host_start;
+    return has_prefix ? PREFIX_HOST : HOST;
+}
+
+//index of the first of the 4 delimiters in s[i, len) or len if there are none
+//repeat a delimiter to search for less than 4
+static inline size_t __itb_find_any4(
+    const char *s, size_t i, size_t len, char a, char b, char c, char d) {
+#if !defined(ITB_NO_SIMD) && defined(__AVX2__)
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    const __m256i vd = _mm256_set1_epi8(d);
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        const __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, vc), _mm256_cmpeq_epi8(v, vd)));
+        const uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+#endif
+#if !defined(ITB_NO_SIMD) && defined(__SSE2__)
+    const __m128i xa = _mm_set1_epi8(a);
+    const __m128i xb = _mm_set1_epi8(b);
+    const __m128i xc = _mm_set1_epi8(c);
+    const __m128i xd = _mm_set1_epi8(d);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        const __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, xa), _mm_cmpeq_epi8(v, xb)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, xc), _mm_cmpeq_epi8(v, xd)));
+        const uint32_t bits = (uint32_t)_mm_movemask_epi8(m);
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+#endif
+    //scalar fallback and the tail
+    for (; i < len; ++i) {
+        if (s[i] == a || s[i] == b || s[i] == c || s[i] == d) {
+            return i;
+        }
+    }
+    return len;
+}
+
+//same as memchr but returns len when c is not found
+static inline size_t __itb_find_byte(const char *s, size_t i, size_t len, char c) {
+#if !defined(ITB_NO_SIMD) && defined(__AVX2__)
+    const __m256i vc = _mm256_set1_epi8(c);
+    //two vectors at a time keeps the loads ahead of the compares on long lines
+    for (; i + 64 <= len; i += 64) {
+        const __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)), vc);
+        const __m256i m1
+            = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i + 32)), vc);
+        const uint64_t bits = (uint32_t)_mm256_movemask_epi8(m0)
+                              | ((uint64_t)(uint32_t)_mm256_movemask_epi8(m1) << 32);
+        if (bits) {
+            return i + __builtin_ctzll(bits);
+        }
+    }
+#endif
+#if !defined(ITB_NO_SIMD) && defined(__SSE2__)
+    const __m128i xc = _mm_set1_epi8(c);
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v     = _mm_loadu_si128((const __m128i *)(s + i));
+        const uint32_t bits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, xc));
+        if (bits) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+#endif
+    //scalar fallback and the tail
+    for (; i < len; ++i) {
+        if (s[i] == c) {
+            return i;
+        }
+    }
+    return len;
+}
+
+static inline bool __itb_is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline bool __itb_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+//scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." )
+static inline bool __itb_uri_valid_scheme(const char *s, size_t len) {
+    if (!len || !__itb_is_alpha(s[0])) {
+        return false;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        if (!__itb_is_alpha(s[i]) && !__itb_is_digit(s[i]) && s[i] != '+' && s[i] != '-'
+            && s[i] != '.') {
+            return false;
+        }
+    }
+    return true;
+}
+
+int itb_uri_parse_parts(itb_uri_parts_t *parts, const char *s, size_t len) {
+    memset(parts, 0, sizeof(itb_uri_parts_t));
+    parts->base = s;
+    parts->port = -1;
+
+    size_t i = 0;
+
+    //the scheme is only a scheme if the first delimiter is a ':'
+    size_t d = __itb_find_any4(s, 0, len, ':', '/', '?', '#');
+    if (d < len && s[d] == ':' && __itb_uri_valid_scheme(s, d)) {
+        parts->scheme.len = d;
+        parts->flags |= ITB_URI_HAS_SCHEME;
+        i = d + 1;
+    }
+
+    //authority = [ userinfo "@" ] host [ ":" port ]
+    if (i + 1 < len && s[i] == '/' && s[i + 1] == '/') {
+        parts->flags |= ITB_URI_HAS_AUTHORITY;
+
+        size_t start = i + 2;
+        size_t end   = __itb_find_any4(s, start, len, '/', '?', '#', '/');
+
+        //userinfo cant contain an unencoded '@' so the first one ends it
+        size_t at = __itb_find_any4(s, start, end, '@', '@', '@', '@');
+        if (at < end) {
+            parts->userinfo.off = start;
+            parts->userinfo.len = at - start;
+            parts->flags |= ITB_URI_HAS_USERINFO;
+            start = at + 1;
+        }
+
+        size_t colon;
+        if (start < end && s[start] == '[') {
+            //ip literal, the ':'s inside belong to the address
+            size_t close = __itb_find_any4(s, start + 1, end, ']', ']', ']', ']');
+            if (close == end) {
+                return -1;
+            }
+            parts->host.off = start + 1;
+            parts->host.len = close - start - 1;
+            parts->flags |= ITB_URI_HOST_IP_LITERAL;
+
+            colon = close + 1;
+            if (colon < end && s[colon] != ':') {
+                return -1;
+            }
+        } else {
+            //reg-name and ipv4 cant contain a ':'
+            colon           = __itb_find_any4(s, start, end, ':', ':', ':', ':');
+            parts->host.off = start;
+            parts->host.len = colon - start;
+        }
+
+        //an empty port is allowed and treated as no port
+        if (colon + 1 < end) {
+            int32_t port = 0;
+            for (size_t p = colon + 1; p < end; ++p) {
+                if (!__itb_is_digit(s[p]) || (port = port * 10 + (s[p] - '0')) > 65535) {
+                    return -1;
+                }
+            }
+            parts->port = port;
+        }
+
+        i = end;
+    }
+
+    size_t q = __itb_find_any4(s, i, len, '?', '#', '#', '#');
+
+    parts->path.off = i;
+    parts->path.len = q - i;
+
+    if (q < len && s[q] == '?') {
+        size_t f = __itb_find_any4(s, q + 1, len, '#', '#', '#', '#');
+
+        parts->query.off = q + 1;
+        parts->query.len = f - q - 1;
+        parts->flags |= ITB_URI_HAS_QUERY;
+        q = f;
+    }
+
+    if (q < len) {
+        parts->fragment.off = q + 1;
+        parts->fragment.len = len - q - 1;
+        parts->flags |= ITB_URI_HAS_FRAGMENT;
+    }
+
+    return 0;
+}
+
+static inline int __itb_hex_val(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+//unreserved = ALPHA / DIGIT / "-" / "." / "_" / "~"
+static inline bool __itb_uri_unreserved(char c) {
+    return __itb_is_alpha(c) || __itb_is_digit(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+//with only_unreserved escapes that must stay are kept but get uppercase hex digits
+static size_t __itb_uri_pct(char *s, size_t len, bool only_unreserved) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    size_t r = __itb_find_any4(s, 0, len, '%', '%', '%', '%');
+    size_t w = r;
+
+    while (r < len) {
+        int hi, lo;
+        if (r + 2 < len && (hi = __itb_hex_val(s[r + 1])) != -1
+            && (lo = __itb_hex_val(s[r + 2])) != -1) {
+            char c = (char)(hi << 4 | lo);
+            if (!only_unreserved || __itb_uri_unreserved(c)) {
+                s[w++] = c;
+            } else {
+                s[w++] = '%';
+                s[w++] = hex[hi];
+                s[w++] = hex[lo];
+            }
+            r += 3;
+        } else {
+            //malformed escape, keep it as is
+            s[w++] = s[r++];
+        }
+
+        //copy the run up to the next escape
+        size_t next = __itb_find_any4(s, r, len, '%', '%', '%', '%');
+        if (w != r) {
+            memmove(s + w, s + r, next - r);
+        }
+        w += next - r;
+        r = next;
+    }
 
-    if (!prefix_eh && !suffix_eh) { //no prefix no suffix
-        type = HOST;
+    return w;
+}
+
+size_t itb_uri_pct_decode(char *s, size_t len) {
+    return __itb_uri_pct(s, len, false);
+}
 
-        ++(uri->len); //'\0'
-        if (!(uri->buffer = malloc(uri->len))) {
-            return ERROR;
+void itb_uri_lower(char *s, size_t len) {
+    size_t i = 0;
+#if !defined(ITB_NO_SIMD) && defined(__AVX2__)
+    const __m256i a    = _mm256_set1_epi8('A' - 1);
+    const __m256i z    = _mm256_set1_epi8('Z' + 1);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        //bytes over 0x7f are negative so they never land in the range
+        __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(v, a), _mm256_cmpgt_epi8(z, v));
+        _mm256_storeu_si256((__m256i *)(s + i), _mm256_or_si256(v, _mm256_and_si256(m, flip)));
+    }
+#endif
+#if !defined(ITB_NO_SIMD) && defined(__SSE2__)
+    const __m128i xa    = _mm_set1_epi8('A' - 1);
+    const __m128i xz    = _mm_set1_epi8('Z' + 1);
+    const __m128i xflip = _mm_set1_epi8(0x20);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, xa), _mm_cmpgt_epi8(xz, v));
+        _mm_storeu_si128((__m128i *)(s + i), _mm_or_si128(v, _mm_and_si128(m, xflip)));
+    }
+#endif
+    for (; i < len; ++i) {
+        if (s[i] >= 'A' && s[i] <= 'Z') {
+            s[i] |= 0x20;
         }
+    }
+}
 
-        uri->prefix = NULL;
-        uri->host   = uri->buffer;
-        strncpy(uri->host, s, uri->len);
+size_t itb_uri_remove_dot_segments(char *s, size_t len) {
+    //no '.' means no dot segments
+    if (__itb_find_any4(s, 0, len, '.', '.', '.', '.') == len) {
+        return len;
+    }
 
-        uri->suffix = NULL;
-    } else if (!prefix_eh && suffix_eh) { //no prefix there is a suffix
-        type = HOST_SUFFIX;
+    //the output never grows past the input so it is written over the front of it
+    size_t r = 0, w = 0;
+    while (r < len) {
+        const size_t left = len - r;
+        if (left >= 3 && !memcmp(s + r, "../", 3)) {
+            r += 3;
+        } else if (left >= 2 && !memcmp(s + r, "./", 2)) {
+            r += 2;
+        } else if (left >= 3 && !memcmp(s + r, "/./", 3)) {
+            r += 2;
+        } else if (left == 2 && !memcmp(s + r, "/.", 2)) {
+            s[w++] = '/';
+            r      = len;
+        } else if ((left >= 4 && !memcmp(s + r, "/../", 4))
+            || (left == 3 && !memcmp(s + r, "/..", 3))) {
+            //drop the last output segment
+            while (w > 0 && s[--w] != '/')
+                ; //loop
+            if (left == 3) {
+                s[w++] = '/';
+                r      = len;
+            } else {
+                r += 3;
+            }
+        } else if ((left == 1 && s[r] == '.') || (left == 2 && !memcmp(s + r, "..", 2))) {
+            r = len;
+        } else {
+            //move the first segment including its leading '/'
+            do {
+                s[w++] = s[r++];
+            } while (r < len && s[r] != '/');
+        }
+    }
+    return w;
+}
 
-        ++(uri->len); //'\0' ':'->'\0'
-        if (!(uri->buffer = malloc(uri->len))) {
-            return ERROR;
+//lower cases a host after its escapes were normalized, the hex digits of escapes that were
+//kept stay upper case as rfc 3986 6.2.2.1 wants
+static void __itb_uri_lower_host(char *s, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '%') {
+            i += 2;
+        } else if (s[i] >= 'A' && s[i] <= 'Z') {
+            s[i] |= 0x20;
         }
+    }
+}
+
+//move a part down to w and normalize it there, returns the new write position
+static size_t __itb_uri_norm_span(char *s, size_t w, itb_uri_span_t *span, bool host) {
+    if (w != span->off) {
+        memmove(s + w, s + span->off, span->len);
+    }
+    span->off = w;
+    span->len = __itb_uri_pct(s + w, span->len, true);
+    if (host) {
+        __itb_uri_lower_host(s + w, span->len);
+    }
+    return w + span->len;
+}
+
+size_t itb_uri_normalize_parts(char *s, itb_uri_parts_t *parts) {
+    //parts are in string order and only shrink so compacting forward never overwrites
+    //anything that hasnt been read yet
+    size_t w = 0;
 
-        size_t suffixlen = strlen(suffix_eh);
-        size_t hostlen   = uri->len - suffixlen - 1; // :
+    if (parts->flags & ITB_URI_HAS_SCHEME) {
+        itb_uri_lower(s, parts->scheme.len);
+        w      = parts->scheme.len;
+        s[w++] = ':';
+    }
 
-        uri->prefix = NULL;
+    if (parts->flags & ITB_URI_HAS_AUTHORITY) {
+        s[w++] = '/';
+        s[w++] = '/';
+        if (parts->flags & ITB_URI_HAS_USERINFO) {
+            w      = __itb_uri_norm_span(s, w, &parts->userinfo, false);
+            s[w++] = '@';
+        }
 
-        uri->host = uri->buffer;
-        strncpy(uri->host, s, hostlen);
-        uri->host[hostlen] = 0;
+        if (parts->flags & ITB_URI_HOST_IP_LITERAL) {
+            s[w++] = '[';
+            w      = __itb_uri_norm_span(s, w, &parts->host, true);
+            s[w++] = ']';
+        } else {
+            w = __itb_uri_norm_span(s, w, &parts->host, true);
+        }
 
-        uri->suffix = uri->host + hostlen + 1;
-        strncpy(uri->suffix, suffix_eh + 1, suffixlen);
-    } else if (prefix_eh == suffix_eh) { //prefix there is no suffix
-        type = PREFIX_HOST;
+        if (parts->port != -1) {
+            char digits[5];
+            int n        = 0;
+            int32_t port = parts->port;
+            do {
+                digits[n++] = '0' + port % 10;
+            } while ((port /= 10));
 
-        --(uri->len); //'\0' '://'->'\0' 3->2
-        if (!(uri->buffer = malloc(uri->len))) {
-            return ERROR;
+            s[w++] = ':';
+            while (n) {
+                s[w++] = digits[--n];
+            }
         }
+    }
 
-        size_t prefixlen = prefix_eh - s;
-        size_t hostlen   = uri->len - prefixlen - 2; // ://
+    w = __itb_uri_norm_span(s, w, &parts->path, false);
+    //dot segments are only resolved for full uris, not relative references
+    if (parts->flags & ITB_URI_HAS_SCHEME) {
+        parts->path.len = itb_uri_remove_dot_segments(s + parts->path.off, parts->path.len);
+        w               = parts->path.off + parts->path.len;
+    }
 
-        uri->prefix = uri->buffer;
-        strncpy(uri->prefix, s, prefixlen);
-        uri->prefix[prefixlen] = 0;
+    if (parts->flags & ITB_URI_HAS_QUERY) {
+        s[w++] = '?';
+        w      = __itb_uri_norm_span(s, w, &parts->query, false);
+    }
 
-        uri->host = uri->prefix + prefixlen + 1;
-        strncpy(uri->host, prefix_eh + 3, hostlen);
-        uri->host[hostlen] = 0;
+    if (parts->flags & ITB_URI_HAS_FRAGMENT) {
+        s[w++] = '#';
+        w      = __itb_uri_norm_span(s, w, &parts->fragment, false);
+    }
 
-        uri->suffix = NULL;
-    } else { //prefix and suffix
-        type = PREFIX_HOST_SUFFIX;
+    parts->base = s;
+    return w;
+}
 
-        --(uri->len); //'\0' '://'->'\0' ':'->'\0' 4->3
-        if (!(uri->buffer = malloc(uri->len))) {
-            return ERROR;
+void itb_uri_normalize(itb_uri_t *uri) {
+    if (!uri->buffer) {
+        return;
+    }
+    if (uri->prefix) {
+        itb_uri_lower(uri->prefix, strlen(uri->prefix));
+    }
+    if (uri->host) {
+        size_t len = __itb_uri_pct(uri->host, strlen(uri->host), true);
+
+        uri->host[len] = '\0';
+        //host also carries the path, only the authority's host is case insensitive
+        //delimiters are reserved so decoding can't have added any
+        size_t end   = __itb_find_any4(uri->host, 0, len, '/', '?', '#', '/');
+        size_t start = end;
+        while (start > 0 && uri->host[start - 1] != '@') {
+            --start;
         }
+        __itb_uri_lower_host(uri->host + start, end - start);
+    }
+}
+
+enum itb_uri_type itb_uri_parse(itb_uri_t *uri, const char *s) {
+    itb_uri_view_t view;
+    enum itb_uri_type type;
+
+    if ((type = itb_uri_view_parse(&view, s, strlen(s))) == ERROR) {
+        return ERROR;
+    }
+
+    //every part gets its own '\0' but shares the one allocation
+    uri->len = view.prefix.len + view.host.len + view.suffix.len + 3;
+    if (!(uri->buffer = malloc(uri->len))) {
+        return ERROR;
+    }
 
-        size_t prefixlen = prefix_eh - s;
-        size_t suffixlen = strlen(suffix_eh);
-        size_t hostlen   = uri->len - prefixlen - suffixlen - 2; // :// :
+    char *next = uri->buffer;
 
-        uri->prefix = uri->buffer;
-        strncpy(uri->prefix, s, prefixlen);
-        uri->prefix[prefixlen] = 0;
+    uri->prefix = NULL;
+    if (type == PREFIX_HOST || type == PREFIX_HOST_SUFFIX) {
+        uri->prefix = next;
+        memcpy(next, ITB_URI_VIEW_PTR(&view, prefix), view.prefix.len);
+        next[view.prefix.len] = '\0';
+        next += view.prefix.len + 1;
+    }
 
-        uri->host = uri->prefix + prefixlen + 1;
-        strncpy(uri->host, prefix_eh + 3, hostlen);
-        uri->host[hostlen] = 0;
+    uri->host = next;
+    memcpy(next, ITB_URI_VIEW_PTR(&view, host), view.host.len);
+    next[view.host.len] = '\0';
+    next += view.host.len + 1;
 
-        uri->suffix = uri->host + hostlen + 1;
-        strncpy(uri->suffix, suffix_eh + 1, suffixlen);
+    uri->suffix = NULL;
+    if (type == HOST_SUFFIX || type == PREFIX_HOST_SUFFIX) {
+        uri->suffix = next;
+        memcpy(next, ITB_URI_VIEW_PTR(&view, suffix), view.suffix.len);
+        next[view.suffix.len] = '\0';
     }
+
     return type;
 }
 
@@ -718,21 +1522,35 @@ void itb_uri_close(itb_uri_t *uri) {
 
 //==>basic menu<==
 int itb_menu_init(itb_menu_t *menu, const char *header) {
+    //everything is set first so a failed header allocation still leaves a usable empty menu
+    menu->total_items      = 0;
+    menu->alloc_items      = 0;
+    menu->items            = NULL;
+    menu->total_selectable = 0;
+    menu->selectable       = NULL;
+    menu->free_on_close    = false;
+    menu->arena            = false;
+    menu->stacked          = NULL;
+
     //to make sure that its as dynamic as possible just copy in the string
     //and let the caller deal with how it happens
     menu->header = malloc(strlen(header) + 1);
     if (menu->header) {
         strcpy(menu->header, header);
-        menu->total_items   = 0;
-        menu->items         = NULL;
-        menu->free_on_close = false;
-        menu->stacked       = NULL;
         return 0;
     }
     return 1;
 }
 
 void itb_menu_close(itb_menu_t *menu) {
+    //the root owns the block and submenus have nothing of their own
+    if (menu->arena) {
+        if (menu->free_on_close) {
+            free(menu);
+        }
+        return;
+    }
+
     //only free if there are items
     if (menu->total_items) {
         while (menu->total_items) {
@@ -760,23 +1578,40 @@ void itb_menu_item_close(itb_menu_item_t *item) {
 }
 
 int itb_menu_register_item(itb_menu_t *menu, itb_menu_item_t *item) {
-    ++menu->total_items;
-    if (menu->items) {
-        itb_menu_item_t **temp = menu->items;
-        menu->items = realloc(menu->items, menu->total_items * sizeof(itb_menu_item_type_t *));
-        if (!menu->items) { //realloc failed
-            menu->items = temp;
-            return -1;
+    if (menu->arena) {
+        return -1;
+    }
+
+    if (menu->total_items == menu->alloc_items) {
+        size_t alloc = menu->alloc_items;
+        if (alloc) {
+            ITB_VECTOR_ENLARGE(alloc);
+        } else {
+            alloc = ITB_VECTOR_INITIAL_SIZE;
         }
-    } else {
-        menu->items = malloc(sizeof(itb_menu_item_type_t *));
-        if (!menu->items) { //malloc failed
+
+        //[items][selectable] in one block, realloc would leave selectable in the wrong spot
+        itb_menu_item_t **temp = malloc(alloc * (sizeof(itb_menu_item_t *) + sizeof(size_t)));
+        if (!temp) { //malloc failed
             return -1;
         }
+        size_t *selectable = (size_t *)(temp + alloc);
+        if (menu->items) {
+            memcpy(temp, menu->items, menu->total_items * sizeof(itb_menu_item_t *));
+            memcpy(selectable, menu->selectable, menu->total_selectable * sizeof(size_t));
+            free(menu->items);
+        }
+        menu->items       = temp;
+        menu->selectable  = selectable;
+        menu->alloc_items = alloc;
+    }
+
+    if (item->type != LABEL) {
+        menu->selectable[menu->total_selectable++] = menu->total_items;
     }
-    menu->items[menu->total_items - 1] = item;
+    menu->items[menu->total_items++] = item;
     return 0;
-};
+}
 
 //usage expects items terminated by a NULL
 //itb_menu_register_items(menu, item1, item2, ..., NULL);
@@ -851,57 +1686,216 @@ itb_menu_item_t *itb_menu_item_toggle(const char *text, bool *flag) {
     return NULL;
 }
 
-void itb_menu_print(const itb_menu_t *menu) {
-    bool s = false;
-    if (menu->stacked) {
-        s    = true;
-        menu = menu->stacked;
-    }
-    printf("<%s>\n", menu->header);
-    size_t i = 0, j = 0;
-    for (; i < menu->total_items; ++i) {
-        if (menu->items[i]->type == LABEL) {
-            printf("%s\n", menu->items[i]->label);
+void itb_menu_builder_init(itb_menu_builder_t *builder) {
+    memset(builder, 0, sizeof(itb_menu_builder_t));
+}
+
+void itb_menu_builder_close(itb_menu_builder_t *builder) {
+    free(builder->headers);
+    free(builder->items);
+    memset(builder, 0, sizeof(itb_menu_builder_t));
+}
+
+int itb_menu_builder_menu(itb_menu_builder_t *builder, const char *header) {
+    if (builder->total_menus == builder->alloc_menus) {
+        size_t alloc = builder->alloc_menus;
+        if (alloc) {
+            ITB_VECTOR_ENLARGE(alloc);
         } else {
-            printf("[%lu] %s\n", ++j, menu->items[i]->label);
+            alloc = ITB_VECTOR_INITIAL_SIZE;
+        }
+        const char **temp;
+        if (!(temp = realloc(builder->headers, alloc * sizeof(const char *)))) {
+            return -1;
         }
+        builder->headers     = temp;
+        builder->alloc_menus = alloc;
     }
+    builder->headers[builder->total_menus] = header;
+    builder->string_size += strlen(header) + 1;
+    return builder->total_menus++;
+}
 
-    if (s) {
-        printf("[%lu] back\n", ++j);
-    } else {
-        printf("[%lu] exit\n", ++j);
+//the next free item, all fields but extra filled in
+static itb_menu_builder_item_t *__itb_menu_builder_item(
+    itb_menu_builder_t *builder, int menu, const char *text, itb_menu_item_type_t type) {
+    if (menu < 0 || (size_t)menu >= builder->total_menus) {
+        return NULL;
+    }
+    if (builder->total_items == builder->alloc_items) {
+        size_t alloc = builder->alloc_items;
+        if (alloc) {
+            ITB_VECTOR_ENLARGE(alloc);
+        } else {
+            alloc = ITB_VECTOR_INITIAL_SIZE;
+        }
+        itb_menu_builder_item_t *temp;
+        if (!(temp = realloc(builder->items, alloc * sizeof(itb_menu_builder_item_t)))) {
+            return NULL;
+        }
+        builder->items       = temp;
+        builder->alloc_items = alloc;
     }
+    itb_menu_builder_item_t *item = builder->items + builder->total_items++;
+    item->type                    = type;
+    item->menu                    = menu;
+    item->text                    = text;
+    builder->string_size += strlen(text) + 1;
+    return item;
 }
 
-void itb_menu_run(const itb_menu_t *menu) {
-    uint8_t buffer[64];
-    char *start = (char *)buffer, *end;
-    ssize_t nread, sel = 0;
-    while (1) {
-        itb_menu_print(menu);
-    invalid:
-        printf("> ");
-        fflush(stdout);
-        if ((nread = itb_readline(buffer, 64)) > 0) {
-            sel = strtoll(start, &end, 10);
-            sel -= 1; //ui uses 1 based for number row but internally we want it zero based
+int itb_menu_builder_label(itb_menu_builder_t *builder, int menu, const char *text) {
+    return __itb_menu_builder_item(builder, menu, text, LABEL) ? 0 : -1;
+}
 
-            //skip labels
-            for (ssize_t i = sel; i < (ssize_t)menu->total_items && i >= 0; --i) {
-                if (menu->items[i]->type == LABEL) {
-                    ++sel;
-                }
-            }
+int itb_menu_builder_callback(
+    itb_menu_builder_t *builder, int menu, const char *text, void (*callback)(void *), void *data) {
+    itb_menu_builder_item_t *item;
+    if (!(item = __itb_menu_builder_item(builder, menu, text, CALLBACK))) {
+        return -1;
+    }
+    item->extra.callback.func = callback;
+    item->extra.callback.data = data;
+    ++builder->total_callbacks;
+    return 0;
+}
 
-            if (start == end || sel < 0
-                || (size_t)sel > menu->total_items) { //is an int and in the right range
-                puts("invalid input");
-                goto invalid;
-            }
+int itb_menu_builder_submenu(itb_menu_builder_t *builder, int menu, const char *text, int submenu) {
+    itb_menu_builder_item_t *item;
+    if (submenu < 0 || (size_t)submenu >= builder->total_menus
+        || !(item = __itb_menu_builder_item(builder, menu, text, MENU))) {
+        return -1;
+    }
+    item->extra.menu = submenu;
+    return 0;
+}
 
-            if ((size_t)sel == menu->total_items) {
-                return;
+int itb_menu_builder_toggle(itb_menu_builder_t *builder, int menu, const char *text, bool *flag) {
+    itb_menu_builder_item_t *item;
+    if (!(item = __itb_menu_builder_item(builder, menu, text, TOGGLE))) {
+        return -1;
+    }
+    item->extra.toggle = flag;
+    return 0;
+}
+
+itb_menu_t *itb_menu_builder_finish(itb_menu_builder_t *builder) {
+    if (!builder->total_menus) {
+        return NULL;
+    }
+
+    //the block is laid out as follows, strings go last since they need no alignment
+    //[menus][items][callbacks][per menu [item pointers][selectable]][strings]
+    const size_t menus_size     = builder->total_menus * sizeof(itb_menu_t);
+    const size_t items_size     = builder->total_items * sizeof(itb_menu_item_t);
+    const size_t callbacks_size = builder->total_callbacks * sizeof(struct itb_callback_item);
+    const size_t index_size = builder->total_items * (sizeof(itb_menu_item_t *) + sizeof(size_t));
+
+    uint8_t *temp = malloc(
+        menus_size + items_size + callbacks_size + index_size + builder->string_size);
+    if (!temp) {
+        return NULL;
+    }
+
+    itb_menu_t *menus      = (itb_menu_t *)temp;
+    itb_menu_item_t *items = (itb_menu_item_t *)(temp + menus_size);
+    struct itb_callback_item *callbacks
+        = (struct itb_callback_item *)(temp + menus_size + items_size);
+    uint8_t *index = temp + menus_size + items_size + callbacks_size;
+    char *strings  = (char *)(index + index_size);
+
+    //count first so each menu gets its slice of the index
+    for (size_t i = 0; i < builder->total_menus; ++i) {
+        menus[i].total_items      = 0;
+        menus[i].total_selectable = 0;
+    }
+    for (size_t i = 0; i < builder->total_items; ++i) {
+        ++menus[builder->items[i].menu].total_items;
+    }
+
+    for (size_t i = 0; i < builder->total_menus; ++i) {
+        const size_t len       = strlen(builder->headers[i]) + 1;
+        const size_t count     = menus[i].total_items;
+        menus[i].free_on_close = !i;
+        menus[i].arena         = true;
+        menus[i].header        = strings;
+        menus[i].alloc_items   = count;
+        menus[i].items         = (itb_menu_item_t **)index;
+        menus[i].selectable    = (size_t *)(index + count * sizeof(itb_menu_item_t *));
+        menus[i].stacked       = NULL;
+        index += count * (sizeof(itb_menu_item_t *) + sizeof(size_t));
+        memcpy(strings, builder->headers[i], len);
+        strings += len;
+        //refilled in order below
+        menus[i].total_items = 0;
+    }
+
+    for (size_t i = 0; i < builder->total_items; ++i) {
+        const itb_menu_builder_item_t *src = builder->items + i;
+        itb_menu_t *menu                   = menus + src->menu;
+        itb_menu_item_t *item              = items + i;
+        const size_t len                   = strlen(src->text) + 1;
+
+        item->free_on_close = false;
+        item->label         = strings;
+        item->type          = src->type;
+        memcpy(strings, src->text, len);
+        strings += len;
+
+        switch (src->type) {
+            case CALLBACK:
+                *callbacks           = src->extra.callback;
+                item->extra.callback = callbacks++;
+                break;
+            case MENU:
+                item->extra.menu = menus + src->extra.menu;
+                break;
+            case TOGGLE:
+                item->extra.toggle = src->extra.toggle;
+                break;
+            default:
+                break;
+        }
+
+        if (item->type != LABEL) {
+            menu->selectable[menu->total_selectable++] = menu->total_items;
+        }
+        menu->items[menu->total_items++] = item;
+    }
+
+    return menus;
+}
+
+void itb_menu_print(const itb_menu_t *menu) {
+    bool s = false;
+    if (menu->stacked) {
+        s    = true;
+        menu = menu->stacked;
+    }
+    char buffer[1024];
+    itb_strbuf_t out;
+    itb_strbuf_init_with(&out, buffer, sizeof(buffer));
+    itb_menu_render(menu, s, &out);
+    fwrite(out.data, 1, out.len, stdout);
+    itb_strbuf_close(&out);
+}
+
+void itb_menu_run(const itb_menu_t *menu) {
+    uint8_t buffer[64];
+    ssize_t nread, sel = 0;
+    while (1) {
+        itb_menu_print(menu);
+    invalid:
+        printf("> ");
+        fflush(stdout);
+        if ((nread = itb_readline(buffer, 64)) > 0) {
+            if ((sel = itb_menu_select(menu, (char *)buffer)) == -1) {
+                puts("invalid input");
+                goto invalid;
+            }
+
+            if ((size_t)sel == menu->total_items) {
+                return;
             }
 
             switch (menu->items[sel]->type) {
@@ -929,23 +1923,11 @@ int itb_menu_run_once(itb_menu_t *menu, const char *line) {
     if (menu->stacked) { //return to last position if set
         menu = menu->stacked;
     }
-    char *end;
     ssize_t sel = 0;
 
     int ret = 0;
     if (strlen(line) > 0) {
-        sel = strtoll(line, &end, 10);
-        sel -= 1; //ui uses 1 based for number row but internally we want it zero based
-
-        //skip labels
-        for (ssize_t i = sel; i < (ssize_t)menu->total_items && i >= 0; --i) {
-            if (menu->items[i]->type == LABEL) {
-                ++sel;
-            }
-        }
-
-        if (line == end || sel < 0
-            || (size_t)sel > menu->total_items) { //is an int and in the right range
+        if ((sel = itb_menu_select(menu, line)) == -1) {
             puts("invalid input");
             return -1;
         }
@@ -988,85 +1970,823 @@ int itb_menu_run_once(itb_menu_t *menu, const char *line) {
     return ret;
 }
 
+//itb_readline file globals
+uint8_t itb_stdin_buffer[ITB_LINEREADER_SIZE];
+itb_linereader_t itb_stdin_reader
+    = {STDIN_FILENO, itb_stdin_buffer, 0, 0, 0, ITB_LINEREADER_SIZE, false, false, false};
+
 ssize_t itb_readline(uint8_t *buffer, size_t len) {
+    char *line;
     ssize_t nread;
 
-    if ((nread = read(STDIN_FILENO, buffer, len)) == -1) {
-        if (errno == EAGAIN) { //stdin is in nonblocking mode
+    //no room for even the '\0', the line is left for the next call
+    if (!len) {
+        return -EINVAL;
+    }
+
+    if ((nread = itb_linereader_next(&itb_stdin_reader, &line)) < 0) {
+        errno = -nread;
+        perror("readline stdin");
+        return nread;
+    }
+
+    if (!line) {
+        //a terminal can still be read from after ^D
+        itb_stdin_reader.eof = false;
+        return 0;
+    }
+
+    //cuts out input thats too long
+    if ((size_t)nread >= len) {
+        nread = len - 1;
+    }
+    memcpy(buffer, line, nread);
+    buffer[nread] = '\0';
+
+    //wipe out the rest of a line longer than the reader buffer
+    while (itb_stdin_reader.partial && itb_linereader_next(&itb_stdin_reader, &line) > 0) {
+    }
+
+    return nread + 1;
+}
+
+//==>line reader<==
+int itb_linereader_init(itb_linereader_t *lr, int fd, size_t size) {
+    if (!size) {
+        size = ITB_LINEREADER_SIZE;
+    }
+    if (!(lr->buffer = malloc(size))) {
+        return -1;
+    }
+    lr->fd            = fd;
+    lr->start         = 0;
+    lr->scan          = 0;
+    lr->end           = 0;
+    lr->alloc         = size;
+    lr->eof           = false;
+    lr->partial       = false;
+    lr->free_on_close = true;
+    return 0;
+}
+
+void itb_linereader_init_with(itb_linereader_t *lr, int fd, void *mem, size_t size) {
+    lr->fd            = fd;
+    lr->buffer        = (uint8_t *)mem;
+    lr->start         = 0;
+    lr->scan          = 0;
+    lr->end           = 0;
+    lr->alloc         = size;
+    lr->eof           = false;
+    lr->partial       = false;
+    lr->free_on_close = false;
+}
+
+void itb_linereader_close(itb_linereader_t *lr) {
+    if (lr->free_on_close) {
+        free(lr->buffer);
+    }
+    lr->buffer = NULL;
+    lr->alloc  = 0;
+}
+
+//hands out [start, end) as a line and consumes through next
+static inline ssize_t __itb_linereader_take(
+    itb_linereader_t *lr, char **line, size_t end, size_t next) {
+    *line           = (char *)lr->buffer + lr->start;
+    lr->buffer[end] = '\0';
+    ssize_t len     = end - lr->start;
+    lr->start       = next;
+    lr->scan        = next;
+    lr->partial     = false;
+    return len;
+}
+
+ssize_t itb_linereader_next(itb_linereader_t *lr, char **line) {
+    while (1) {
+        //only new data is searched, never the partial line from last time
+        const uint8_t *nl = memchr(lr->buffer + lr->scan, '\n', lr->end - lr->scan);
+        if (nl) {
+            const size_t idx = nl - lr->buffer;
+            return __itb_linereader_take(lr, line, idx, idx + 1);
+        }
+        lr->scan = lr->end;
+
+        if (lr->eof) {
+            if (lr->start != lr->end) {
+                return __itb_linereader_take(lr, line, lr->end, lr->end);
+            }
+            *line = NULL;
             return 0;
-        } else {
-            perror("readline stdin");
+        }
+
+        //move the partial line to the front
+        if (lr->start) {
+            memmove(lr->buffer, lr->buffer + lr->start, lr->end - lr->start);
+            lr->end -= lr->start;
+            lr->scan -= lr->start;
+            lr->start = 0;
+        }
+
+        //one byte is always kept for the '\0'
+        if (lr->end + 1 >= lr->alloc) {
+            if (!lr->free_on_close) {
+                ssize_t len = __itb_linereader_take(lr, line, lr->end, lr->end);
+                lr->partial = true;
+                return len;
+            }
+            size_t alloc = lr->alloc;
+            ITB_VECTOR_ENLARGE(alloc);
+            uint8_t *temp;
+            if (!(temp = realloc(lr->buffer, alloc))) {
+                return -ENOMEM;
+            }
+            lr->buffer = temp;
+            lr->alloc  = alloc;
+        }
+
+        ssize_t nread = read(lr->fd, lr->buffer + lr->end, lr->alloc - 1 - lr->end);
+        if (nread < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) { //fd is in nonblocking mode
+                *line = NULL;
+                return 0;
+            }
             return -errno;
         }
+
+        if (!nread) {
+            lr->eof = true;
+        }
+        lr->end += nread;
     }
+}
 
-    if (!nread) {
+//==>file lines<==
+int itb_lines_open(itb_lines_t *lines, const char *path) {
+    int fd;
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    if (itb_lines_open_fd(lines, fd)) {
+        close(fd);
+        return -1;
+    }
+    lines->free_on_close = true;
+    return 0;
+}
+
+int itb_lines_open_fd(itb_lines_t *lines, int fd) {
+    struct stat st;
+    if (fstat(fd, &st)) {
+        return -1;
+    }
+
+    lines->fd            = fd;
+    lines->pos           = 0;
+    lines->mapped        = false;
+    lines->buffered      = false;
+    lines->free_on_close = false;
+
+    if (S_ISREG(st.st_mode)) {
+        //an empty file cant be mapped but there is nothing to read anyway
+        lines->data = NULL;
+        lines->size = st.st_size;
+        if (!lines->size) {
+            return 0;
+        }
+        void *map;
+        if ((map = mmap(NULL, lines->size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+            madvise(map, lines->size, MADV_SEQUENTIAL);
+            lines->data   = (const char *)map;
+            lines->mapped = true;
+            return 0;
+        }
+    }
+
+    //pipes, sockets, ttys and files that refuse to map
+    if (itb_linereader_init(&lines->reader, fd, ITB_LINES_READ_SIZE)) {
+        return -1;
+    }
+    lines->data     = NULL;
+    lines->size     = 0;
+    lines->buffered = true;
+    return 0;
+}
+
+void itb_lines_init_mem(itb_lines_t *lines, const char *data, size_t size) {
+    lines->data          = data;
+    lines->size          = size;
+    lines->pos           = 0;
+    lines->fd            = -1;
+    lines->mapped        = false;
+    lines->buffered      = false;
+    lines->free_on_close = false;
+}
+
+void itb_lines_close(itb_lines_t *lines) {
+    if (lines->mapped) {
+        munmap((void *)lines->data, lines->size);
+    }
+    if (lines->buffered) {
+        itb_linereader_close(&lines->reader);
+    }
+    if (lines->free_on_close) {
+        close(lines->fd);
+    }
+    lines->data     = NULL;
+    lines->size     = 0;
+    lines->mapped   = false;
+    lines->buffered = false;
+}
+
+int itb_lines_next(itb_lines_t *lines, itb_line_t *line) {
+    if (lines->buffered) {
+        char *ptr;
+        ssize_t len;
+        if ((len = itb_linereader_next(&lines->reader, &ptr)) < 0) {
+            return len;
+        }
+        line->ptr = ptr;
+        line->len = len;
+        return ptr != NULL;
+    }
+
+    if (lines->pos >= lines->size) {
         return 0;
     }
+    const size_t nl = __itb_find_byte(lines->data, lines->pos, lines->size, '\n');
+    line->ptr       = lines->data + lines->pos;
+    line->len       = nl - lines->pos;
+    //a last line without a '\n' ends at size
+    lines->pos = nl + 1;
+    return 1;
+}
 
-    if (nread == (ssize_t)len) { // full read: either exact or trailing input
-        if (buffer[nread - 1] != '\n') { //trailing input
-            uint8_t tmp[256];
-            ssize_t tmpread;
-            //wipe out trailing input
-            do {
-                tmpread = read(STDIN_FILENO, tmp, 256);
-                //if its negative its an error so quit
-                //if its exact theres either more to read or it was a line that fit perfectly and would end in '\n'
-            } while (tmpread != -1 && tmpread == 256 && tmp[tmpread - 1] != '\n');
+typedef struct {
+    itb_lines_t chunk;
+    size_t index;
+    void (*func)(itb_lines_t *chunk, size_t index, void *data);
+    void *data;
+} itb_lines_job_t;
+
+static void *__itb_lines_worker(void *arg) {
+    itb_lines_job_t *job = arg;
+    job->func(&job->chunk, job->index, job->data);
+    return NULL;
+}
+
+int itb_lines_parallel(itb_lines_t *lines, size_t threads,
+    void (*func)(itb_lines_t *chunk, size_t index, void *data), void *data) {
+    if (lines->buffered || !threads) {
+        return -1;
+    }
+
+    itb_lines_job_t *jobs;
+    pthread_t *ids;
+    if (!(jobs = malloc(threads * (sizeof(itb_lines_job_t) + sizeof(pthread_t))))) {
+        return -1;
+    }
+    ids = (pthread_t *)(jobs + threads);
+
+    //cut at roughly equal sizes then push each cut past the next '\n'
+    const size_t start = lines->pos < lines->size ? lines->pos : lines->size;
+    const size_t step  = (lines->size - start) / threads;
+    size_t pos         = start;
+    for (size_t i = 0; i < threads; ++i) {
+        size_t end = i + 1 == threads ? lines->size : start + step * (i + 1);
+        if (end < pos) {
+            end = pos;
+        }
+        if (end < lines->size && end > pos) {
+            end = __itb_find_byte(lines->data, end - 1, lines->size, '\n');
+            end += end < lines->size;
+        }
+        itb_lines_init_mem(&jobs[i].chunk, lines->data + pos, end - pos);
+        jobs[i].index = i;
+        jobs[i].func  = func;
+        jobs[i].data  = data;
+        pos           = end;
+    }
+
+    //the calling thread takes the first chunk
+    size_t started = 1;
+    for (; started < threads; ++started) {
+        if (pthread_create(ids + started, NULL, __itb_lines_worker, jobs + started)) {
+            break;
         }
-        //} else { exact match fall through and replace the '\n' with a '\0'
     }
+    __itb_lines_worker(jobs);
+    //anything that failed to start runs here
+    for (size_t i = started; i < threads; ++i) {
+        __itb_lines_worker(jobs + i);
+    }
+    for (size_t i = 1; i < started; ++i) {
+        pthread_join(ids[i], NULL);
+    }
+
+    lines->pos = lines->size;
+    free(jobs);
+    return 0;
+}
+
+//==>number formatting<==
+static const char __itb_digit_pairs[201] = "00010203040506070809"
+                                           "10111213141516171819"
+                                           "20212223242526272829"
+                                           "30313233343536373839"
+                                           "40414243444546474849"
+                                           "50515253545556575859"
+                                           "60616263646566676869"
+                                           "70717273747576777879"
+                                           "80818283848586878889"
+                                           "90919293949596979899";
+
+size_t itb_fmt_u64(char *out, uint64_t v) {
+    size_t len = 1;
+    for (uint64_t p = 10; len < 20 && v >= p; p *= 10) {
+        ++len;
+    }
+
+    //two digits per division from the back
+    char *c = out + len;
+    while (v >= 100) {
+        const uint64_t i = (v % 100) * 2;
+        v /= 100;
+        c -= 2;
+        memcpy(c, __itb_digit_pairs + i, 2);
+    }
+    if (v >= 10) {
+        memcpy(c - 2, __itb_digit_pairs + v * 2, 2);
+    } else {
+        c[-1] = '0' + v;
+    }
+    return len;
+}
+
+size_t itb_fmt_i64(char *out, int64_t v) {
+    if (v < 0) {
+        *out = '-';
+        //negate as unsigned so INT64_MIN works
+        return itb_fmt_u64(out + 1, -(uint64_t)v) + 1;
+    }
+    return itb_fmt_u64(out, v);
+}
+
+size_t itb_fmt_hex(char *out, uint64_t v) {
+    static const char hex[] = "0123456789abcdef";
+    size_t len = 1;
+    while (len < 16 && v >> (len * 4)) {
+        ++len;
+    }
+    for (size_t i = len; i; --i, v >>= 4) {
+        out[i - 1] = hex[v & 0xf];
+    }
+    return len;
+}
 
-    buffer[nread - 1] = '\0'; //replace '\n' with '\0' or cuts out input thats too long
+//just enough of a bignum for the shortest float search
+//the largest value it sees is a bit over 2^180
+typedef struct {
+    uint32_t w[8];
+    int n;
+} __itb_big_t;
+
+static inline void __itb_big_set(__itb_big_t *b, uint64_t v) {
+    b->w[0] = (uint32_t)v;
+    b->w[1] = (uint32_t)(v >> 32);
+    b->n    = b->w[1] ? 2 : b->w[0] ? 1 : 0;
+}
 
-    return nread;
+static inline void __itb_big_mul(__itb_big_t *b, uint32_t m) {
+    uint64_t carry = 0;
+    for (int i = 0; i < b->n; ++i) {
+        carry += (uint64_t)b->w[i] * m;
+        b->w[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) {
+        b->w[b->n++] = (uint32_t)carry;
+    }
+}
+
+static inline void __itb_big_shl(__itb_big_t *b, int bits) {
+    const int words = bits / 32;
+    bits %= 32;
+    if (!b->n) {
+        return;
+    }
+    b->w[b->n + words] = 0;
+    for (int i = b->n - 1; i >= 0; --i) {
+        b->w[i + words + 1] |= bits ? b->w[i] >> (32 - bits) : 0;
+        b->w[i + words] = b->w[i] << bits;
+    }
+    for (int i = 0; i < words; ++i) {
+        b->w[i] = 0;
+    }
+    b->n += words + 1;
+    if (!b->w[b->n - 1]) {
+        --b->n;
+    }
+}
+
+static inline int __itb_big_cmp(const __itb_big_t *a, const __itb_big_t *b) {
+    if (a->n != b->n) {
+        return a->n < b->n ? -1 : 1;
+    }
+    for (int i = a->n - 1; i >= 0; --i) {
+        if (a->w[i] != b->w[i]) {
+            return a->w[i] < b->w[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static inline void __itb_big_add(__itb_big_t *out, const __itb_big_t *a, const __itb_big_t *b) {
+    const int n    = a->n > b->n ? a->n : b->n;
+    uint64_t carry = 0;
+    for (int i = 0; i < n; ++i) {
+        carry += (uint64_t)(i < a->n ? a->w[i] : 0) + (i < b->n ? b->w[i] : 0);
+        out->w[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    out->n = n;
+    if (carry) {
+        out->w[out->n++] = (uint32_t)carry;
+    }
+}
+
+//a -= b, a must be >= b
+static inline void __itb_big_sub(__itb_big_t *a, const __itb_big_t *b) {
+    int64_t borrow = 0;
+    for (int i = 0; i < a->n; ++i) {
+        borrow += (int64_t)a->w[i] - (i < b->n ? b->w[i] : 0);
+        a->w[i] = (uint32_t)borrow;
+        borrow >>= 32;
+    }
+    while (a->n && !a->w[a->n - 1]) {
+        --a->n;
+    }
+}
+
+//free format shortest digits (Steele & White / Burger & Dybvig, the exact algorithm
+//that Grisu and Ryu speed up) value = 0.digits * 10^k
+static int __itb_float_digits(uint32_t mant, int e, bool min_exp, char *digits, int *k) {
+    __itb_big_t r, s, mp, mm, t;
+    //round half even means the ends of the rounding interval read back as v
+    const bool even = !(mant & 1);
+
+    //r / s = v and mp / s, mm / s are half the gaps to the next floats up and down
+    //the gap below is smaller at a power of 2
+    const bool unequal = mant == (1u << 23) && !min_exp;
+    if (e >= 0) {
+        __itb_big_set(&r, mant);
+        __itb_big_shl(&r, e + (unequal ? 2 : 1));
+        __itb_big_set(&s, unequal ? 4 : 2);
+        __itb_big_set(&mm, 1);
+        __itb_big_shl(&mm, e);
+        __itb_big_set(&mp, 1);
+        __itb_big_shl(&mp, e + unequal);
+    } else {
+        __itb_big_set(&r, (uint64_t)mant << (unequal ? 2 : 1));
+        __itb_big_set(&s, 1);
+        __itb_big_shl(&s, -e + (unequal ? 2 : 1));
+        __itb_big_set(&mm, 1);
+        __itb_big_set(&mp, unequal ? 2 : 1);
+    }
+
+    //estimate k = ceil(log10(v)) from the top bit, 78913 / 2^18 ~= log10(2)
+    //this is either right or one too small, the loop below fixes that
+    const int top = e + 31 - __builtin_clz(mant);
+    int est       = top >= 0 ? ((top * 78913) >> 18) + (top != 0) : -((-top * 78913) >> 18);
+    if (est >= 0) {
+        for (int i = 0; i < est; ++i) {
+            __itb_big_mul(&s, 10);
+        }
+    } else {
+        for (int i = 0; i < -est; ++i) {
+            __itb_big_mul(&r, 10);
+            __itb_big_mul(&mp, 10);
+            __itb_big_mul(&mm, 10);
+        }
+    }
+    while (1) {
+        __itb_big_add(&t, &r, &mp);
+        if (even ? __itb_big_cmp(&t, &s) < 0 : __itb_big_cmp(&t, &s) <= 0) {
+            break;
+        }
+        __itb_big_mul(&s, 10);
+        ++est;
+    }
+    *k = est;
+
+    int n = 0;
+    while (1) {
+        __itb_big_mul(&r, 10);
+        __itb_big_mul(&mp, 10);
+        __itb_big_mul(&mm, 10);
+
+        char d = 0;
+        while (__itb_big_cmp(&r, &s) >= 0) {
+            __itb_big_sub(&r, &s);
+            ++d;
+        }
+
+        __itb_big_add(&t, &r, &mp);
+        const bool low  = even ? __itb_big_cmp(&r, &mm) <= 0 : __itb_big_cmp(&r, &mm) < 0;
+        bool high       = even ? __itb_big_cmp(&t, &s) >= 0 : __itb_big_cmp(&t, &s) > 0;
+
+        if (!low && !high) {
+            digits[n++] = '0' + d;
+            continue;
+        }
+
+        if (low && high) {
+            //both round trip, take the closer one and break ties to even
+            t = r;
+            __itb_big_shl(&t, 1);
+            const int cmp = __itb_big_cmp(&t, &s);
+            high          = cmp > 0 || (!cmp && (d & 1));
+        }
+        digits[n++] = '0' + d + high;
+        return n;
+    }
+}
+
+#ifdef __SIZEOF_INT128__
+//same search as __itb_float_digits in 128 bit integers which covers roughly 1e-20 to 1e20
+//returns -1 when the numbers dont fit and the bignum version has to be used
+static int __itb_float_digits_fast(uint32_t mant, int e, bool min_exp, char *digits, int *k) {
+    typedef unsigned __int128 u128;
+    //anything under this can be multiplied by 10 and added to without overflowing
+    const u128 limit = (u128)1 << 123;
+
+    const bool even    = !(mant & 1);
+    const bool unequal = mant == (1u << 23) && !min_exp;
+    u128 r, s, mp, mm;
+    if (e >= 0) {
+        if (e > 96) {
+            return -1;
+        }
+        r  = (u128)mant << (e + (unequal ? 2 : 1));
+        s  = unequal ? 4 : 2;
+        mm = (u128)1 << e;
+        mp = (u128)1 << (e + unequal);
+    } else {
+        if (-e > 120) {
+            return -1;
+        }
+        r  = (u128)mant << (unequal ? 2 : 1);
+        s  = (u128)1 << (-e + (unequal ? 2 : 1));
+        mm = 1;
+        mp = unequal ? 2 : 1;
+    }
+
+    const int top = e + 31 - __builtin_clz(mant);
+    int est       = top >= 0 ? ((top * 78913) >> 18) + (top != 0) : -((-top * 78913) >> 18);
+    for (int i = 0; i < est; ++i) {
+        if ((s *= 10) >= limit) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < -est; ++i) {
+        if ((r *= 10) >= limit) {
+            return -1;
+        }
+        mp *= 10;
+        mm *= 10;
+    }
+    while (even ? r + mp >= s : r + mp > s) {
+        if ((s *= 10) >= limit) {
+            return -1;
+        }
+        ++est;
+    }
+    *k = est;
+
+    int n = 0;
+    while (1) {
+        r *= 10;
+        mp *= 10;
+        mm *= 10;
+
+        char d = 0;
+        while (r >= s) {
+            r -= s;
+            ++d;
+        }
+
+        const bool low = even ? r <= mm : r < mm;
+        bool high      = even ? r + mp >= s : r + mp > s;
+
+        if (!low && !high) {
+            digits[n++] = '0' + d;
+            continue;
+        }
+
+        if (low && high) {
+            high = r * 2 > s || (r * 2 == s && (d & 1));
+        }
+        digits[n++] = '0' + d + high;
+        return n;
+    }
+}
+#endif
+
+size_t itb_fmt_float(char *out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+
+    char *c       = out;
+    const int exp = (bits >> 23) & 0xff;
+    uint32_t mant = bits & 0x7fffff;
+
+    if (exp == 0xff) {
+        if (mant) {
+            memcpy(c, "nan", 3);
+            return 3;
+        }
+        if (bits >> 31) {
+            *c++ = '-';
+        }
+        memcpy(c, "inf", 3);
+        return c - out + 3;
+    }
+
+    if (bits >> 31) {
+        *c++ = '-';
+    }
+
+    if (!exp && !mant) {
+        memcpy(c, "0.0", 3);
+        return c - out + 3;
+    }
+
+    int e;
+    if (exp) {
+        mant |= 1u << 23;
+        e = exp - 150;
+    } else {
+        e = -149;
+    }
+
+    //exact integers that fit in the mantissa are their own shortest digits
+    if (e <= 0 && e > -24 && !(mant & ((1u << -e) - 1))) {
+        c += itb_fmt_u64(c, mant >> -e);
+        memcpy(c, ".0", 2);
+        return c - out + 2;
+    }
+
+    char digits[12];
+    int k, n = -1;
+#ifdef __SIZEOF_INT128__
+    n = __itb_float_digits_fast(mant, e, exp <= 1, digits, &k);
+#endif
+    if (n == -1) {
+        n = __itb_float_digits(mant, e, exp <= 1, digits, &k);
+    }
+
+    if (k <= 0) {
+        //0.000ddd
+        *c++ = '0';
+        *c++ = '.';
+        memset(c, '0', -k);
+        c += -k;
+        memcpy(c, digits, n);
+        c += n;
+    } else if (k < n) {
+        //dd.ddd
+        memcpy(c, digits, k);
+        c += k;
+        *c++ = '.';
+        memcpy(c, digits + k, n - k);
+        c += n - k;
+    } else {
+        //ddd000.0
+        memcpy(c, digits, n);
+        c += n;
+        memset(c, '0', k - n);
+        c += k - n;
+        *c++ = '.';
+        *c++ = '0';
+    }
+    return c - out;
 }
 
 //==>QOL wrappers<==
+//ITB_PF_LITERAL for anything that isnt a conversion, used is how many chars of c it took
+static inline itb_printf_op_type_t __itb_printf_type(const char *c, size_t *used) {
+    *used = 1;
+    switch (c[0]) {
+        case 'c':
+            return ITB_PF_CHAR;
+        case 's':
+            return ITB_PF_STRING;
+        case 'd':
+            return ITB_PF_INT;
+        case 'f':
+            return ITB_PF_FLOAT;
+        case 'u':
+            return ITB_PF_UINT;
+        case 'x':
+            return ITB_PF_HEX;
+        case 'p':
+            return ITB_PF_PTR;
+        case 'l':
+            if (c[1] == 'd' || c[1] == 'u') {
+                *used = 2;
+                return c[1] == 'd' ? ITB_PF_LONG : ITB_PF_ULONG;
+            }
+            return ITB_PF_LITERAL;
+        case 'z':
+            if (c[1] == 'u') {
+                *used = 2;
+                return ITB_PF_SIZE;
+            }
+            return ITB_PF_LITERAL;
+        default:
+            //what?
+            return ITB_PF_LITERAL;
+    }
+}
+
+//writes a single conversion at si, returns the new si
+static size_t __itb_printf_arg(
+    itb_printf_op_type_t type, char *str, size_t str_size, size_t si, void *arg) {
+    char tmp[ITB_FMT_FLOAT_MAX];
+    size_t len;
+
+    switch (type) {
+        case ITB_PF_CHAR:
+            str[si++] = *(char *)arg;
+            return si;
+        case ITB_PF_STRING: {
+            char *fs = (char *)arg;
+            while (*fs && si < str_size) {
+                str[si++] = *fs++;
+            }
+        }
+            return si;
+        case ITB_PF_FLOAT:
+            len = itb_fmt_float(tmp, *(float *)arg);
+            break;
+        case ITB_PF_INT:
+            len = itb_fmt_i64(tmp, *(int *)arg);
+            break;
+        case ITB_PF_UINT:
+            len = itb_fmt_u64(tmp, *(unsigned *)arg);
+            break;
+        case ITB_PF_LONG:
+            len = itb_fmt_i64(tmp, *(long *)arg);
+            break;
+        case ITB_PF_ULONG:
+            len = itb_fmt_u64(tmp, *(unsigned long *)arg);
+            break;
+        case ITB_PF_SIZE:
+            len = itb_fmt_u64(tmp, *(size_t *)arg);
+            break;
+        case ITB_PF_HEX:
+            len = itb_fmt_hex(tmp, *(unsigned *)arg);
+            break;
+        case ITB_PF_PTR:
+            if (arg) {
+                memcpy(tmp, "0x", 2);
+                len = itb_fmt_hex(tmp + 2, (uintptr_t)arg) + 2;
+            } else {
+                memcpy(tmp, "(nil)", 5);
+                len = 5;
+            }
+            break;
+        default:
+            return si;
+    }
+
+    //formatted on the side so truncation is exact
+    if (len > str_size - si) {
+        len = str_size - si;
+    }
+    memcpy(str + si, tmp, len);
+    return si + len;
+}
+
 ssize_t itb_printf(char *str, size_t str_size, const char *format, size_t args_size, void **args) {
     size_t si = 0;
 
     bool flag = false;
 
-    for (size_t fi = 0, sa = 0; format[fi] && si < str_size && sa < args_size; ++fi) {
+    for (size_t fi = 0, sa = 0; format[fi] && si < str_size; ++fi) {
         if (flag) { //last char was a %
             if (format[fi] == '%') { //literal %
                 flag      = false;
                 str[si++] = '%';
             } else {
-                switch (format[fi]) { //possibly just detect format specifiers and pass them off to snprintf
-                    case 'c':
-                        str[si++] = *(char *)(args[sa++]);
-                        break;
-                    case 's': {
-                        char *fs = (char *)(args[sa++]);
-                        while (*fs && si < str_size) {
-                            str[si++] = *fs++;
-                        }
-                    } break;
-                    case 'f': {
-                        //TODO double check running into the end of the output buffer with this
-                        int len = snprintf(str + si, str_size - si, "%f", *(float *)(args[sa++]));
-                        if ((size_t)len > str_size - si) {
-                            si = str_size - 1;
-                        } else {
-                            return -1;
-                        }
-                    } break;
-                    case 'd': {
-                        //itoa is non standard ugh
-                        int len = snprintf(str + si, str_size - si, "%d", *(int *)(args[sa++]));
-                        if (len > 0) {
-                            si += len;
-                        } else {
-                            return -1;
-                        }
-                    } break;
-                    default:
-                        //what?
-                        break;
+                size_t used;
+                itb_printf_op_type_t type = __itb_printf_type(format + fi, &used);
+                //conversions past the last argument print nothing, literal text still does
+                if (type != ITB_PF_LITERAL && sa < args_size) {
+                    si = __itb_printf_arg(type, str, str_size, si, args[sa++]);
                 }
+                fi += used - 1;
                 flag = false;
             }
         } else {
@@ -1081,6 +2801,773 @@ ssize_t itb_printf(char *str, size_t str_size, const char *format, size_t args_s
     return si;
 }
 
+int itb_printf_compile(itb_printf_plan_t *plan, const char *format) {
+    //worst case every char starts a new op
+    size_t max_ops = 1;
+    for (const char *c = format; *c; ++c) {
+        max_ops += *c == '%';
+    }
+    max_ops *= 2;
+
+    itb_printf_op_t *ops = malloc(max_ops * sizeof(itb_printf_op_t));
+    if (!ops) {
+        return -1;
+    }
+
+    size_t total = 0;
+    const char *lit = format;
+    const char *c   = format;
+    while (*c) {
+        if (*c != '%') {
+            ++c;
+            continue;
+        }
+
+        //"%%" keeps the first '%' in the current literal and skips the second
+        if (c[1] == '%') {
+            c += 2;
+            ops[total].type = ITB_PF_LITERAL;
+            ops[total].lit  = lit;
+            ops[total].len  = c - lit - 1;
+            ++total;
+            lit = c;
+            continue;
+        }
+
+        if (c != lit) {
+            ops[total].type = ITB_PF_LITERAL;
+            ops[total].lit  = lit;
+            ops[total].len  = c - lit;
+            ++total;
+        }
+
+        if (!c[1]) {
+            //trailing '%' is dropped like itb_printf does
+            lit = ++c;
+            break;
+        }
+
+        size_t used;
+        itb_printf_op_type_t type = __itb_printf_type(c + 1, &used);
+        if (type != ITB_PF_LITERAL) {
+            ops[total].type = type;
+            ops[total].lit  = NULL;
+            ops[total].len  = 0;
+            ++total;
+        }
+        c += 1 + used;
+        lit = c;
+    }
+
+    if (c != lit) {
+        ops[total].type = ITB_PF_LITERAL;
+        ops[total].lit  = lit;
+        ops[total].len  = c - lit;
+        ++total;
+    }
+
+    plan->ops           = ops;
+    plan->total_ops     = total;
+    plan->free_on_close = true;
+    return 0;
+}
+
+void itb_printf_close(itb_printf_plan_t *plan) {
+    if (plan->free_on_close) {
+        free((void *)plan->ops);
+    }
+    plan->ops       = NULL;
+    plan->total_ops = 0;
+}
+
+ssize_t itb_printf_exec(const itb_printf_plan_t *plan, char *str, size_t str_size, void **args) {
+    size_t si = 0, sa = 0;
+
+    for (size_t i = 0; i < plan->total_ops && si < str_size; ++i) {
+        const itb_printf_op_t *op = plan->ops + i;
+        if (op->type == ITB_PF_LITERAL) {
+            size_t len = op->len < str_size - si ? op->len : str_size - si;
+            memcpy(str + si, op->lit, len);
+            si += len;
+        } else {
+            si = __itb_printf_arg(op->type, str, str_size, si, args[sa++]);
+        }
+    }
+
+    return si;
+}
+
+//==>string builder<==
+int itb_strbuf_init(itb_strbuf_t *sb, size_t size) {
+    sb->len      = 0;
+    sb->alloc    = size ? size : ITB_STRBUF_INITIAL_SIZE;
+    sb->external = false;
+    if ((sb->data = malloc(sb->alloc))) {
+        return 0;
+    }
+    sb->alloc = 0;
+    return -1;
+}
+
+void itb_strbuf_init_with(itb_strbuf_t *sb, void *mem, size_t size) {
+    sb->data     = (char *)mem;
+    sb->len      = 0;
+    sb->alloc    = size;
+    sb->external = true;
+}
+
+void itb_strbuf_close(itb_strbuf_t *sb) {
+    if (!sb->external) {
+        free(sb->data);
+    }
+    sb->data  = NULL;
+    sb->len   = 0;
+    sb->alloc = 0;
+}
+
+int itb_strbuf_reserve(itb_strbuf_t *sb, size_t extra) {
+    if (sb->len + extra <= sb->alloc) {
+        return 0;
+    }
+
+    size_t alloc = sb->alloc ? sb->alloc : ITB_STRBUF_INITIAL_SIZE;
+    while (alloc < sb->len + extra) {
+        ITB_VECTOR_ENLARGE(alloc);
+    }
+
+    char *temp;
+    if (sb->external) {
+        //the caller still owns the old memory so copy out of it
+        if (!(temp = malloc(alloc))) {
+            return -1;
+        }
+        memcpy(temp, sb->data, sb->len);
+        sb->external = false;
+    } else if (!(temp = realloc(sb->data, alloc))) {
+        return -1;
+    }
+
+    sb->data  = temp;
+    sb->alloc = alloc;
+    return 0;
+}
+
+int itb_strbuf_append(itb_strbuf_t *sb, const char *s, size_t len) {
+    if (itb_strbuf_reserve(sb, len)) {
+        return -1;
+    }
+    memcpy(sb->data + sb->len, s, len);
+    sb->len += len;
+    return 0;
+}
+
+int itb_strbuf_append_str(itb_strbuf_t *sb, const char *s) {
+    return itb_strbuf_append(sb, s, strlen(s));
+}
+
+int itb_strbuf_append_char(itb_strbuf_t *sb, char c) {
+    if (itb_strbuf_reserve(sb, 1)) {
+        return -1;
+    }
+    sb->data[sb->len++] = c;
+    return 0;
+}
+
+//the kernels write straight into the builder
+int itb_strbuf_append_i64(itb_strbuf_t *sb, int64_t v) {
+    if (itb_strbuf_reserve(sb, ITB_FMT_INT_MAX + 1)) {
+        return -1;
+    }
+    sb->len += itb_fmt_i64(sb->data + sb->len, v);
+    return 0;
+}
+
+int itb_strbuf_append_u64(itb_strbuf_t *sb, uint64_t v) {
+    if (itb_strbuf_reserve(sb, ITB_FMT_INT_MAX)) {
+        return -1;
+    }
+    sb->len += itb_fmt_u64(sb->data + sb->len, v);
+    return 0;
+}
+
+int itb_strbuf_append_hex(itb_strbuf_t *sb, uint64_t v) {
+    if (itb_strbuf_reserve(sb, ITB_FMT_HEX_MAX)) {
+        return -1;
+    }
+    sb->len += itb_fmt_hex(sb->data + sb->len, v);
+    return 0;
+}
+
+int itb_strbuf_append_float(itb_strbuf_t *sb, float v) {
+    if (itb_strbuf_reserve(sb, ITB_FMT_FLOAT_MAX)) {
+        return -1;
+    }
+    sb->len += itb_fmt_float(sb->data + sb->len, v);
+    return 0;
+}
+
+//itb_printf only reports what fit so a completely full buffer means it might have been cut
+//short, grow and go again until there is space left over
+int itb_strbuf_printf(itb_strbuf_t *sb, const char *format, size_t args_size, void **args) {
+    size_t extra = ITB_STRBUF_INITIAL_SIZE;
+    while (1) {
+        if (itb_strbuf_reserve(sb, extra)) {
+            return -1;
+        }
+        const size_t room = sb->alloc - sb->len;
+        const size_t ret  = (size_t)itb_printf(sb->data + sb->len, room, format, args_size, args);
+        if (ret < room) {
+            sb->len += ret;
+            return 0;
+        }
+        extra = room * 2;
+    }
+}
+
+int itb_strbuf_printf_exec(itb_strbuf_t *sb, const itb_printf_plan_t *plan, void **args) {
+    size_t extra = ITB_STRBUF_INITIAL_SIZE;
+    while (1) {
+        if (itb_strbuf_reserve(sb, extra)) {
+            return -1;
+        }
+        const size_t room = sb->alloc - sb->len;
+        const size_t ret  = (size_t)itb_printf_exec(plan, sb->data + sb->len, room, args);
+        if (ret < room) {
+            sb->len += ret;
+            return 0;
+        }
+        extra = room * 2;
+    }
+}
+
+char *itb_strbuf_cstr(itb_strbuf_t *sb) {
+    if (itb_strbuf_reserve(sb, 1)) {
+        return NULL;
+    }
+    sb->data[sb->len] = '\0';
+    return sb->data;
+}
+
+
+//==>menu sessions<==
+static _Thread_local itb_menu_session_t *__itb_menu_session_current = NULL;
+
+int itb_menu_render(const itb_menu_t *menu, bool nested, itb_strbuf_t *out) {
+    int ret = itb_strbuf_append_char(out, '<');
+    ret |= itb_strbuf_append_str(out, menu->header);
+    ret |= itb_strbuf_append(out, ">\n", 2);
+
+    //labels arent numbered
+    uint64_t j = 0;
+    for (size_t i = 0; i < menu->total_items; ++i) {
+        if (menu->items[i]->type != LABEL) {
+            ret |= itb_strbuf_append_char(out, '[');
+            ret |= itb_strbuf_append_u64(out, ++j);
+            ret |= itb_strbuf_append(out, "] ", 2);
+        }
+        ret |= itb_strbuf_append_str(out, menu->items[i]->label);
+        ret |= itb_strbuf_append_char(out, '\n');
+    }
+
+    ret |= itb_strbuf_append_char(out, '[');
+    ret |= itb_strbuf_append_u64(out, ++j);
+    ret |= itb_strbuf_append_str(out, nested ? "] back\n" : "] exit\n");
+    return ret;
+}
+
+ssize_t itb_menu_select(const itb_menu_t *menu, const char *line) {
+    char *end;
+    long long sel = strtoll(line, &end, 10);
+    if (line == end || sel < 1) {
+        return -1;
+    }
+
+    //ui uses 1 based numbers that skip labels
+    if ((size_t)sel <= menu->total_selectable) {
+        return menu->selectable[sel - 1];
+    }
+    return (size_t)sel == menu->total_selectable + 1 ? (ssize_t)menu->total_items : -1;
+}
+
+static int __itb_menu_session_show(itb_menu_session_t *session) {
+    return itb_menu_render(session->stack[session->depth - 1], session->depth > 1, &session->out)
+           | itb_strbuf_append(&session->out, "> ", 2);
+}
+
+//one complete line, same choices as itb_menu_run
+static int __itb_menu_session_line(itb_menu_session_t *session, const char *line) {
+    itb_menu_t *menu = session->stack[session->depth - 1];
+    if (!*line) {
+        return itb_strbuf_append(&session->out, "> ", 2);
+    }
+
+    ssize_t sel;
+    if ((sel = itb_menu_select(menu, line)) == -1) {
+        return itb_strbuf_append_str(&session->out, "invalid input\n> ");
+    }
+
+    if ((size_t)sel == menu->total_items) {
+        if (!--session->depth) {
+            session->done = true;
+            return 0;
+        }
+        return __itb_menu_session_show(session);
+    }
+
+    itb_menu_item_t *item = menu->items[sel];
+    switch (item->type) {
+        case CALLBACK:
+            __itb_menu_session_current = session;
+            item->extra.callback->func(item->extra.callback->data);
+            __itb_menu_session_current = NULL;
+            break;
+        case MENU:
+            if (session->depth == ITB_MENU_SESSION_DEPTH) {
+                return itb_strbuf_append_str(&session->out, "menu too deep\n> ");
+            }
+            session->stack[session->depth++] = item->extra.menu;
+            break;
+        case TOGGLE:
+            (*item->extra.toggle) = !(*item->extra.toggle);
+            break;
+        default:
+            break;
+    }
+    return __itb_menu_session_show(session);
+}
+
+int itb_menu_session_init(itb_menu_session_t *session, itb_menu_t *menu) {
+    if (itb_strbuf_init(&session->out, 0)) {
+        return -1;
+    }
+    session->stack[0]   = menu;
+    session->depth      = 1;
+    session->line_len   = 0;
+    session->discarding = false;
+    session->done       = false;
+    session->data       = NULL;
+    return __itb_menu_session_show(session);
+}
+
+void itb_menu_session_close(itb_menu_session_t *session) {
+    itb_strbuf_close(&session->out);
+    session->depth = 0;
+}
+
+int itb_menu_session_feed(itb_menu_session_t *session, const char *data, size_t len) {
+    size_t i = 0;
+    while (i < len && !session->done) {
+        const size_t nl   = __itb_find_byte(data, i, len, '\n');
+        const size_t take = nl - i;
+
+        //keep what fits, anything longer is an invalid line anyway
+        if (!session->discarding) {
+            if (session->line_len + take < ITB_MENU_SESSION_LINE) {
+                memcpy(session->line + session->line_len, data + i, take);
+                session->line_len += take;
+            } else {
+                session->discarding = true;
+            }
+        }
+
+        if (nl == len) {
+            break;
+        }
+        i = nl + 1;
+
+        int ret;
+        if (session->discarding) {
+            ret = itb_strbuf_append_str(&session->out, "invalid input\n> ");
+        } else {
+            //nc and telnet send \r\n
+            if (session->line_len && session->line[session->line_len - 1] == '\r') {
+                --session->line_len;
+            }
+            session->line[session->line_len] = '\0';
+            ret = __itb_menu_session_line(session, session->line);
+        }
+        session->line_len   = 0;
+        session->discarding = false;
+        if (ret) {
+            return -1;
+        }
+    }
+    return session->done;
+}
+
+itb_menu_session_t *itb_menu_session_current(void) {
+    return __itb_menu_session_current;
+}
+
+//==>deferred logger<==
+//records are [uint32 len][uint32 id] followed by one 8 byte slot per conversion,
+//%s copies the string including the '\0' padded out to 8
+#define ITB_LOG_WRAP UINT32_MAX
+#define ITB_LOG_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+typedef struct itb_log_ring_t {
+    //producer side
+    _Alignas(64) uint64_t head;
+    uint64_t cached_tail;
+    uint64_t dropped;
+    //consumer side
+    _Alignas(64) uint64_t tail;
+    uint64_t reported;
+    //set once the owning thread exits, the backend frees it after draining
+    bool closed;
+    struct itb_log_ring_t *next;
+    _Alignas(64) uint8_t data[ITB_LOG_RING_SIZE];
+} itb_log_ring_t;
+
+//itb_log file globals
+itb_printf_plan_t itb_log_formats[ITB_LOG_MAX_FORMATS];
+uint8_t itb_log_format_args[ITB_LOG_MAX_FORMATS];
+int itb_log_total_formats = 0;
+itb_log_ring_t *itb_log_rings = NULL;
+pthread_mutex_t itb_log_mut = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t itb_log_key;
+pthread_t itb_log_thread;
+int itb_log_fd = -1;
+bool itb_log_running = false;
+//bumped on every init so rings left over from a previous run are not reused
+uint32_t itb_log_gen = 0;
+uint64_t itb_log_written = 0;
+//drops from rings that have already been freed
+uint64_t itb_log_lost = 0;
+//completed backend passes, used by itb_log_flush
+uint64_t itb_log_passes = 0;
+
+static _Thread_local itb_log_ring_t *__itb_log_tls_ring = NULL;
+static _Thread_local uint32_t __itb_log_tls_gen = 0;
+
+static inline size_t __itb_log_arg_size(itb_printf_op_type_t type) {
+    switch (type) {
+        case ITB_PF_CHAR:
+            return sizeof(char);
+        case ITB_PF_INT:
+            return sizeof(int);
+        case ITB_PF_FLOAT:
+            return sizeof(float);
+        case ITB_PF_UINT:
+        case ITB_PF_HEX:
+            return sizeof(unsigned);
+        case ITB_PF_LONG:
+        case ITB_PF_ULONG:
+            return sizeof(long);
+        case ITB_PF_SIZE:
+            return sizeof(size_t);
+        default:
+            return 0;
+    }
+}
+
+static void __itb_log_thread_exit(void *ring) {
+    __atomic_store_n(&((itb_log_ring_t *)ring)->closed, true, __ATOMIC_RELEASE);
+}
+
+//cold path, the first message from each thread
+static itb_log_ring_t *__itb_log_ring_new(void) {
+    itb_log_ring_t *ring;
+    if (posix_memalign((void **)&ring, 64, sizeof(itb_log_ring_t))) {
+        return NULL;
+    }
+    ring->head        = 0;
+    ring->cached_tail = 0;
+    ring->dropped     = 0;
+    ring->tail        = 0;
+    ring->reported    = 0;
+    ring->closed      = false;
+
+    pthread_mutex_lock(&itb_log_mut);
+    ring->next    = itb_log_rings;
+    itb_log_rings = ring;
+    pthread_mutex_unlock(&itb_log_mut);
+
+    pthread_setspecific(itb_log_key, ring);
+    __itb_log_tls_ring = ring;
+    __itb_log_tls_gen  = itb_log_gen;
+    return ring;
+}
+
+static void __itb_log_write_all(const char *data, size_t len) {
+    while (len) {
+        ssize_t ret = write(itb_log_fd, data, len);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            //nowhere left to report it
+            return;
+        }
+        data += ret;
+        len -= ret;
+    }
+}
+
+//formats everything currently in the ring, returns how many records it took
+static size_t __itb_log_drain(itb_log_ring_t *ring, itb_strbuf_t *sb) {
+    const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail       = ring->tail;
+    size_t total        = 0;
+    void *args[ITB_LOG_MAX_ARGS];
+
+    while (tail != head) {
+        uint8_t *rec = ring->data + (tail & (ITB_LOG_RING_SIZE - 1));
+        uint32_t len, id;
+        memcpy(&len, rec, sizeof(uint32_t));
+        memcpy(&id, rec + sizeof(uint32_t), sizeof(uint32_t));
+
+        if (id != ITB_LOG_WRAP) {
+            const itb_printf_plan_t *plan = itb_log_formats + id;
+            uint8_t *slot                 = rec + 8;
+            size_t sa                     = 0;
+            for (size_t i = 0; i < plan->total_ops; ++i) {
+                const itb_printf_op_type_t type = plan->ops[i].type;
+                if (type == ITB_PF_LITERAL) {
+                    continue;
+                }
+                if (type == ITB_PF_STRING) {
+                    args[sa++] = slot;
+                    slot += ITB_LOG_ALIGN(strlen((char *)slot) + 1);
+                } else if (type == ITB_PF_PTR) {
+                    memcpy(args + sa++, slot, sizeof(void *));
+                    slot += 8;
+                } else {
+                    args[sa++] = slot;
+                    slot += 8;
+                }
+            }
+            itb_strbuf_printf_exec(sb, plan, args);
+            ++total;
+        }
+
+        tail += len;
+        if (sb->len >= ITB_LOG_BATCH_SIZE) {
+            __itb_log_write_all(sb->data, sb->len);
+            itb_strbuf_clear(sb);
+            __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    //the strings in args point into the ring so the space is only handed back once written
+    if (sb->len) {
+        __itb_log_write_all(sb->data, sb->len);
+        itb_strbuf_clear(sb);
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    const uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->reported) {
+        itb_strbuf_append_str(sb, "itb_log: dropped ");
+        itb_strbuf_append_u64(sb, dropped - ring->reported);
+        itb_strbuf_append_str(sb, " messages\n");
+        __itb_log_write_all(sb->data, sb->len);
+        itb_strbuf_clear(sb);
+        ring->reported = dropped;
+    }
+
+    __atomic_add_fetch(&itb_log_written, total, __ATOMIC_RELAXED);
+    return total;
+}
+
+//one pass over every ring, closed rings are freed once they are empty
+static size_t __itb_log_pass(itb_strbuf_t *sb) {
+    size_t total = 0;
+    pthread_mutex_lock(&itb_log_mut);
+    itb_log_ring_t *ring = itb_log_rings;
+    pthread_mutex_unlock(&itb_log_mut);
+
+    //new rings are only ever pushed on the front so the rest of the list is stable
+    while (ring) {
+        itb_log_ring_t *next = ring->next;
+        const bool closed    = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+        total += __itb_log_drain(ring, sb);
+        if (closed) {
+            pthread_mutex_lock(&itb_log_mut);
+            itb_log_ring_t **link = &itb_log_rings;
+            while (*link != ring) {
+                link = &(*link)->next;
+            }
+            *link = next;
+            __atomic_add_fetch(&itb_log_lost, ring->dropped, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&itb_log_mut);
+            free(ring);
+        }
+        ring = next;
+    }
+
+    __atomic_add_fetch(&itb_log_passes, 1, __ATOMIC_RELEASE);
+    return total;
+}
+
+static void *__itb_log_backend(void *unused) {
+    (void)unused;
+    itb_strbuf_t sb;
+    itb_ensure(!itb_strbuf_init(&sb, ITB_LOG_BATCH_SIZE + ITB_STRBUF_INITIAL_SIZE));
+
+    const struct timespec idle = {0, ITB_LOG_IDLE_US * 1000};
+    while (__atomic_load_n(&itb_log_running, __ATOMIC_ACQUIRE)) {
+        if (!__itb_log_pass(&sb)) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    //whatever was logged before close
+    __itb_log_pass(&sb);
+
+    itb_strbuf_close(&sb);
+    return NULL;
+}
+
+int itb_log_init(int fd) {
+    if (pthread_key_create(&itb_log_key, __itb_log_thread_exit)) {
+        return -1;
+    }
+    itb_log_fd            = fd;
+    itb_log_total_formats = 0;
+    itb_log_written       = 0;
+    itb_log_lost          = 0;
+    itb_log_passes        = 0;
+    ++itb_log_gen;
+    __atomic_store_n(&itb_log_running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&itb_log_thread, NULL, __itb_log_backend, NULL)) {
+        itb_log_running = false;
+        pthread_key_delete(itb_log_key);
+        return -1;
+    }
+    return 0;
+}
+
+void itb_log_close(void) {
+    __atomic_store_n(&itb_log_running, false, __ATOMIC_RELEASE);
+    pthread_join(itb_log_thread, NULL);
+    pthread_key_delete(itb_log_key);
+
+    while (itb_log_rings) {
+        itb_log_ring_t *next = itb_log_rings->next;
+        free(itb_log_rings);
+        itb_log_rings = next;
+    }
+    for (int i = 0; i < itb_log_total_formats; ++i) {
+        itb_printf_close(itb_log_formats + i);
+    }
+    itb_log_total_formats = 0;
+    itb_log_fd            = -1;
+}
+
+int itb_log_register(const char *format) {
+    pthread_mutex_lock(&itb_log_mut);
+    const int id = itb_log_total_formats;
+    if (id == ITB_LOG_MAX_FORMATS || itb_printf_compile(itb_log_formats + id, format)) {
+        pthread_mutex_unlock(&itb_log_mut);
+        return -1;
+    }
+
+    size_t total_args = 0;
+    for (size_t i = 0; i < itb_log_formats[id].total_ops; ++i) {
+        total_args += itb_log_formats[id].ops[i].type != ITB_PF_LITERAL;
+    }
+    if (total_args > ITB_LOG_MAX_ARGS) {
+        itb_printf_close(itb_log_formats + id);
+        pthread_mutex_unlock(&itb_log_mut);
+        return -1;
+    }
+    itb_log_format_args[id] = total_args;
+
+    //publish the plan before the id can be seen
+    __atomic_store_n(&itb_log_total_formats, id + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&itb_log_mut);
+    return id;
+}
+
+int itb_log(int id, void **args) {
+    itb_log_ring_t *ring = __itb_log_tls_ring;
+    if (__builtin_expect(!ring || __itb_log_tls_gen != itb_log_gen, 0)) {
+        if (!(ring = __itb_log_ring_new())) {
+            return -1;
+        }
+    }
+
+    //size the record first, only strings vary
+    const itb_printf_plan_t *plan = itb_log_formats + id;
+    size_t len                    = 8 + (size_t)itb_log_format_args[id] * 8;
+    size_t sa                     = 0;
+    for (size_t i = 0; i < plan->total_ops; ++i) {
+        const itb_printf_op_type_t type = plan->ops[i].type;
+        if (type == ITB_PF_STRING) {
+            len += ITB_LOG_ALIGN(strlen((char *)args[sa]) + 1) - 8;
+        }
+        sa += type != ITB_PF_LITERAL;
+    }
+
+    uint64_t head      = ring->head;
+    const size_t off   = head & (ITB_LOG_RING_SIZE - 1);
+    const size_t room  = ITB_LOG_RING_SIZE - off;
+    //records never straddle the end, the rest is skipped with a wrap record
+    const size_t need  = len <= room ? len : len + room;
+    if (head + need - ring->cached_tail > ITB_LOG_RING_SIZE) {
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if (len > ITB_LOG_RING_SIZE / 2 || head + need - ring->cached_tail > ITB_LOG_RING_SIZE) {
+            __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+    }
+
+    if (len > room) {
+        const uint32_t wrap[2] = {room, ITB_LOG_WRAP};
+        memcpy(ring->data + off, wrap, sizeof(wrap));
+        head += room;
+    }
+
+    uint8_t *rec          = ring->data + (head & (ITB_LOG_RING_SIZE - 1));
+    const uint32_t hdr[2] = {len, id};
+    memcpy(rec, hdr, sizeof(hdr));
+
+    uint8_t *slot = rec + 8;
+    sa            = 0;
+    for (size_t i = 0; i < plan->total_ops; ++i) {
+        const itb_printf_op_type_t type = plan->ops[i].type;
+        if (type == ITB_PF_LITERAL) {
+            continue;
+        }
+        if (type == ITB_PF_STRING) {
+            const size_t slen = strlen((char *)args[sa]) + 1;
+            memcpy(slot, args[sa++], slen);
+            slot += ITB_LOG_ALIGN(slen);
+        } else if (type == ITB_PF_PTR) {
+            memcpy(slot, args + sa++, sizeof(void *));
+            slot += 8;
+        } else {
+            memcpy(slot, args[sa++], __itb_log_arg_size(type));
+            slot += 8;
+        }
+    }
+
+    __atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void itb_log_flush(void) {
+    if (!__atomic_load_n(&itb_log_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    const struct timespec idle = {0, ITB_LOG_IDLE_US * 1000};
+    //the pass in progress may have already looked at our ring, the one after it cant have
+    const uint64_t target = __atomic_load_n(&itb_log_passes, __ATOMIC_ACQUIRE) + 2;
+    while (__atomic_load_n(&itb_log_passes, __ATOMIC_ACQUIRE) < target) {
+        nanosleep(&idle, NULL);
+    }
+}
+
+void itb_log_stats(itb_log_stats_t *stats) {
+    stats->written = __atomic_load_n(&itb_log_written, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&itb_log_lost, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&itb_log_mut);
+    for (itb_log_ring_t *ring = itb_log_rings; ring; ring = ring->next) {
+        stats->dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&itb_log_mut);
+}
+
 #endif //ITB_IMPLEMENTATION
 
 #ifdef __cplusplus
@@ -34,9 +34,24 @@ extern "C" {
 
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <stdio.h>
 
+//the io_uring backend needs 6.0 kernel headers for multishot recv and provided buffer rings
+//define ITB_NO_URING to leave it out entirely
+#if !defined(ITB_NO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if !defined(ITB_NO_URING) && defined(IORING_RECV_MULTISHOT)
+#define ITB_URING
+#endif
+
 //==>assert macros<==
 #ifndef ITB_ASSERTS
 #define ITB_ASSERTS
@@ -91,6 +106,69 @@ ITBDEF void itb_set_non_blocking(int sfd);
 ITBDEF void itb_make_storage(struct sockaddr_storage *addr, const char *host, int port);
 ITBDEF int itb_print_addr(char **buff, struct sockaddr_storage *addr);
 
+//==>async dns<==
+//getaddrinfo runs on a pool of worker threads and completions are signaled
+//through an eventfd so they can be picked up from an epoll loop
+//results are cached per host for ttl_ms, the port is applied on the way out
+#ifndef ITB_RESOLVER_MAX_WORKERS
+#define ITB_RESOLVER_MAX_WORKERS 16
+#endif
+
+//number of cache slots, must be a power of 2
+#ifndef ITB_RESOLVER_CACHE_SIZE
+#define ITB_RESOLVER_CACHE_SIZE 256
+#endif
+
+typedef struct itb_resolve_req_t {
+    //set by the caller, host must stay valid until the request completes
+    const char *host;
+    int port;
+    //AF_UNSPEC, AF_INET or AF_INET6
+    int family;
+    void *data;
+    //set on completion, status is 0 or the getaddrinfo error
+    int status;
+    socklen_t addr_len;
+    struct sockaddr_storage addr;
+    struct itb_resolve_req_t *next;
+} itb_resolve_req_t;
+
+typedef struct {
+    //254 covers the longest valid dns name plus its '\0'
+    char host[254];
+    int family;
+    int64_t expires;
+    socklen_t addr_len;
+    struct sockaddr_storage addr;
+} itb_resolver_entry_t;
+
+typedef struct {
+    //readable whenever there are completed requests
+    int efd;
+    int ttl_ms;
+    bool closing;
+    size_t total_workers;
+    pthread_t workers[ITB_RESOLVER_MAX_WORKERS];
+    pthread_mutex_t mut;
+    pthread_cond_t cond;
+    itb_resolve_req_t *pending_head;
+    itb_resolve_req_t *pending_tail;
+    itb_resolve_req_t *done;
+    itb_resolver_entry_t *cache;
+} itb_resolver_t;
+
+ITBDEF int itb_resolver_init(itb_resolver_t *res, size_t workers, int ttl_ms);
+//outstanding requests are dropped
+ITBDEF void itb_resolver_close(itb_resolver_t *res);
+//1 answered from the cache and req is already filled in, 0 queued, -1 error
+ITBDEF int itb_resolve_async(itb_resolver_t *res, itb_resolve_req_t *req);
+//call when efd is readable, returns the completed requests linked through next
+ITBDEF itb_resolve_req_t *itb_resolver_completed(itb_resolver_t *res);
+//blocking like itb_make_storage but goes through the cache first
+//0 on success or the getaddrinfo error
+ITBDEF int itb_make_storage_cached(
+    itb_resolver_t *res, struct sockaddr_storage *addr, const char *host, int port);
+
 //==>tcp wrappers<==
 //functions for setting up TCP
 ITBDEF void itb_set_listening(int sfd);
@@ -99,8 +177,183 @@ ITBDEF int itb_make_tcp();
 ITBDEF int itb_make_connected(const char *address, const char *port);
 ITBDEF int itb_accept_blind(int sfd);
 ITBDEF int itb_accept_addr(int sfd, struct sockaddr_storage *addr);
+//accepts until the backlog is empty or max connections (0 for no limit)
+//fds come back nonblocking and close on exec from accept4 so there is no fcntl per connection
+//cb owns fd from then on, returning -1 from it stops the loop
+//returns how many were accepted or -1 if the first accept failed, EMFILE and ENFILE stop early
+ITBDEF int itb_accept_all(int sfd,
+    int (*cb)(int fd, struct sockaddr_storage *addr, void *ctx), void *ctx, size_t max);
+//accepted sockets inherit these from the listener so a connection storm doesn't pay for
+//setsockopt calls on each of them
+#define ITB_SOCK_NODELAY 1
+#define ITB_SOCK_KEEPALIVE 2
+//listener only, wake accept once the first data arrived instead of on the handshake
+#define ITB_SOCK_DEFER_ACCEPT 4
+ITBDEF int itb_set_listener_opts(int sfd, int opts);
+//reads until the buffer is full or nothing is left, 0 covers both eof and EAGAIN
+//use itb_recv_bounded when those need telling apart
 ITBDEF ssize_t itb_recv(int sockfd, uint8_t *buffer, size_t len);
 ITBDEF ssize_t itb_send(int sockfd, const uint8_t *buffer, size_t len);
+//scatter gather versions, *iov and *iovcnt are a cursor moved past whatever was transferred
+//so the same call resumes after a partial write, the first entry may be adjusted in place
+//both loop until everything is done or the socket would block, non sockets use readv/writev
+//returns bytes sent, 0 when the socket was already full, -1 on error
+ITBDEF ssize_t itb_sendv(int sockfd, struct iovec **iov, int *iovcnt);
+//returns bytes read, 0 on eof, -1 with errno EAGAIN when nothing was ready
+ITBDEF ssize_t itb_recvv(int sockfd, struct iovec **iov, int *iovcnt);
+//skips len bytes of the cursor, emptied entries are dropped from the front
+ITBDEF void itb_iov_advance(struct iovec **iov, int *iovcnt, size_t len);
+
+//==>async connect<==
+//nonblocking connects raced over every address of a host in the happy eyeballs style,
+//families alternate starting with ipv6 and a new attempt starts every stagger ms or as soon
+//as the last one failed, the first to complete wins and the rest are closed
+//the attempts live on their own epoll fd which can be added to an outer epoll or itb_loop_t
+
+#ifndef ITB_CONNECT_MAX_ADDRS
+#define ITB_CONNECT_MAX_ADDRS 16
+#endif
+
+//rfc 8305 recommends 250ms
+#ifndef ITB_CONNECT_STAGGER
+#define ITB_CONNECT_STAGGER 250
+#endif
+
+typedef struct {
+    //readable whenever an attempt finished
+    int efd;
+    //the connected nonblocking socket once itb_connect_poll returned 1
+    int fd;
+    int stagger_ms;
+    int64_t deadline;
+    int64_t next_start;
+    //errno of the last failed attempt
+    int error;
+    size_t total_addrs;
+    size_t next_addr;
+    size_t in_flight;
+    struct sockaddr_storage addrs[ITB_CONNECT_MAX_ADDRS];
+    socklen_t addr_lens[ITB_CONNECT_MAX_ADDRS];
+    int fds[ITB_CONNECT_MAX_ADDRS];
+} itb_connect_t;
+
+//resolves with a blocking getaddrinfo then starts the first attempt
+//stagger_ms 0 for ITB_CONNECT_STAGGER, timeout_ms is the deadline for the whole race
+//0 started, -1 with errno set or EAI_* as the negative return when resolving failed
+//itb_connect_close is safe but not needed after a failed start
+ITBDEF int itb_connect_start(
+    itb_connect_t *conn, const char *host, const char *port, int stagger_ms, int timeout_ms);
+//same with addresses from somewhere else, eg itb_resolver_t, tried in the given order
+ITBDEF int itb_connect_start_addrs(itb_connect_t *conn, const struct sockaddr_storage *addrs,
+    size_t total, int stagger_ms, int timeout_ms);
+//waits at most timeout ms (0 to only check, -1 as long as needed) and moves the race along
+//1 connected and conn->fd is set, 0 still going, -1 failed with errno ETIMEDOUT or the last error
+ITBDEF int itb_connect_poll(itb_connect_t *conn, int timeout);
+//ms until the next attempt or the deadline, for waiting on efd from an outer loop
+ITBDEF int itb_connect_timeout(const itb_connect_t *conn);
+//closes the losing attempts and efd, conn->fd is left to the caller
+ITBDEF void itb_connect_close(itb_connect_t *conn);
+//blocking itb_make_connected with a deadline, -1 on failure instead of exiting
+ITBDEF int itb_make_connected_timeout(const char *host, const char *port, int timeout_ms);
+
+//==>bounded receives<==
+//why a receive loop stopped, got holds what was read either way
+typedef enum {
+    //the buffer filled up, more may be waiting
+    ITB_RECV_FULL,
+    //drained, wait for the next EPOLLIN
+    ITB_RECV_AGAIN,
+    //the peer closed its side
+    ITB_RECV_EOF,
+    //errno is set, the connection is done
+    ITB_RECV_ERROR,
+    //max_calls reached before draining, with EPOLLET come back without waiting on epoll
+    ITB_RECV_LIMIT,
+} itb_recv_status_t;
+
+//max_calls caps the recv syscalls so one fast sender can't hold up the loop, 0 for no cap
+ITBDEF itb_recv_status_t itb_recv_bounded(
+    int sockfd, uint8_t *buffer, size_t len, size_t *got, int max_calls);
+
+//byte ring that sockets read straight into, size has to be a power of 2
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    //free running, tail - head bytes are readable
+    size_t head;
+    size_t tail;
+} itb_recv_ring_t;
+
+ITBDEF int itb_recv_ring_init(itb_recv_ring_t *ring, size_t size);
+ITBDEF void itb_recv_ring_close(itb_recv_ring_t *ring);
+//fills the free space with readv across the wrap, FULL means the ring has no room left
+ITBDEF itb_recv_status_t itb_recv_ring(
+    int sockfd, itb_recv_ring_t *ring, size_t *got, int max_calls);
+//the readable bytes up to the wrap, call again after consuming to get the rest
+ITBDEF uint8_t *itb_recv_ring_peek(itb_recv_ring_t *ring, size_t *len);
+ITBDEF void itb_recv_ring_consume(itb_recv_ring_t *ring, size_t len);
+
+//==>file transmission<==
+//move data between fds inside the kernel without copying through userspace
+//nonblocking sockets return early when full, call again with the same offset once writable
+
+//sends up to len bytes of fd starting at *off, which is advanced past what was sent
+//returns the bytes sent this call, 0 if the socket was already full or fd ended, -1 on error
+ITBDEF ssize_t itb_sendfile(int sockfd, int fd, off_t *off, size_t len);
+
+//one side of a splice has to be a pipe, itb_splicer_t keeps one around for fd to fd copies
+typedef struct {
+    int pipe[2];
+    //bytes sitting in the pipe that fd_out didn't take yet
+    size_t pending;
+    //fd_in ended, whatever is pending still needs to go out
+    bool eof;
+} itb_splicer_t;
+
+ITBDEF int itb_splicer_init(itb_splicer_t *splicer);
+ITBDEF void itb_splicer_close(itb_splicer_t *splicer);
+//moves up to len bytes from fd_in to fd_out, off_in is NULL for sockets and pipes
+//returns bytes written to fd_out, 0 when neither side can make progress, -1 on error
+//len counts what is read from fd_in so pass the remaining length not counting pending
+//once eof is set or len reaches 0 keep calling until pending is 0
+ITBDEF ssize_t itb_splice(itb_splicer_t *splicer, int fd_in, off_t *off_in, int fd_out, size_t len);
+
+//==>zero copy sends<==
+//MSG_ZEROCOPY pins the pages of a send instead of copying them, the buffer belongs to the
+//kernel until a completion for that send shows up on the socket error queue
+//completions make the socket report EPOLLERR, call itb_zerocopy_complete on it then
+//EPOLLERR needs no interest bit, an itb_loop_add with the fds usual events already gets it
+//only worth it from around 10KB per send, below that the page pinning costs more than a copy
+
+//how many sends can wait on completions at once, must be a power of 2
+#ifndef ITB_ZEROCOPY_MAX
+#define ITB_ZEROCOPY_MAX 1024
+#endif
+
+typedef struct {
+    //called once per send in order, data is what was passed to itb_send_zerocopy
+    void (*release)(void *data);
+    void *pending[ITB_ZEROCOPY_MAX];
+    //the kernel numbers each zero copy send from 0, head is the next one to complete
+    uint32_t head;
+    uint32_t tail;
+    //completions where the kernel fell back to copying, eg loopback or a nic without sg
+    size_t copied;
+    size_t completed;
+} itb_zerocopy_t;
+
+//sets SO_ZEROCOPY, -1 when the kernel doesn't support it
+ITBDEF int itb_enable_zerocopy(int sockfd);
+ITBDEF void itb_zerocopy_init(itb_zerocopy_t *zc, void (*release)(void *data));
+//like itb_send, a partial send still holds on to the whole buffer until its completion
+//-1 with errno ENOBUFS when ITB_ZEROCOPY_MAX sends are waiting or the kernel ran out of
+//option memory, complete some and try again
+ITBDEF ssize_t itb_send_zerocopy(
+    itb_zerocopy_t *zc, int sockfd, const uint8_t *buffer, size_t len, void *data);
+//drains the error queue and releases finished buffers, returns how many or -1
+ITBDEF int itb_zerocopy_complete(itb_zerocopy_t *zc, int sockfd);
+//sends still waiting on the kernel
+ITBDEF size_t itb_zerocopy_outstanding(const itb_zerocopy_t *zc);
 
 //==>unix wrappers<==
 ITBDEF int itb_make_bound_unix(const char *path);
@@ -110,6 +363,14 @@ ITBDEF int itb_make_connected_unix(const char *path);
 //functions for setting up UDP
 ITBDEF int itb_make_bound_udp(int port);
 ITBDEF int itb_make_udp();
+//segmentation offload, one syscall moves a whole super buffer of same sized datagrams
+//the _opts versions return -1 if the kernel does not support what was asked for
+#define ITB_UDP_GSO 1
+#define ITB_UDP_GRO 2
+ITBDEF int itb_make_bound_udp_opts(int port, int opts);
+ITBDEF int itb_make_udp_opts(int opts);
+//largest super buffer either side handles
+#define ITB_UDP_SEGMENTS_MAX 65507
 ITBDEF ssize_t itb_read_message(int sockfd, uint8_t *buffer, size_t len);
 ITBDEF ssize_t itb_read_message_addr(
     int sockfd, uint8_t *buffer, size_t len, struct sockaddr_storage *addr);
@@ -117,6 +378,54 @@ ITBDEF ssize_t itb_read_message_port(int sockfd, uint8_t *buffer, size_t len, in
 ITBDEF ssize_t itb_send_message(
     int sockfd, const uint8_t *buffer, size_t len, const struct sockaddr_storage *addr);
 
+//batched versions over recvmmsg/sendmmsg, each datagram keeps its own buffer and address
+//datagrams per syscall
+#ifndef ITB_MMSG_MAX
+#define ITB_MMSG_MAX 64
+#endif
+
+typedef struct {
+    uint8_t *buffer;
+    //capacity for reads
+    size_t size;
+    //bytes received or bytes to send
+    size_t len;
+    //source on read, destination on send, NULL if not wanted or the socket is connected
+    struct sockaddr_storage *addr;
+    //set on read, ie MSG_TRUNC when the datagram did not fit
+    int flags;
+} itb_message_t;
+
+//returns how many of msgs were filled, 0 if nothing is waiting
+ITBDEF int itb_read_messages(int sockfd, itb_message_t *msgs, size_t total);
+//returns how many of msgs were sent before the socket buffer filled up
+ITBDEF int itb_send_messages(int sockfd, const itb_message_t *msgs, size_t total);
+
+//sends buffer as len / segment datagrams of segment bytes plus a shorter last one
+//the kernel splits it on ITB_UDP_GSO sockets, anything else falls back to sendmmsg
+//returns bytes sent, 0 if the socket buffer is full
+//-1 with errno EINVAL when segment is 0 or larger than ITB_UDP_SEGMENTS_MAX
+ITBDEF ssize_t itb_send_segments(int sockfd, const uint8_t *buffer, size_t len, uint16_t segment,
+    const struct sockaddr_storage *addr);
+//reads what the kernel coalesced on an ITB_UDP_GRO socket, every segment bytes in buffer is
+//one datagram and the last may be shorter, segment is the whole read for a lone datagram
+//returns bytes read, 0 if nothing is waiting
+ITBDEF ssize_t itb_read_segments(int sockfd, uint8_t *buffer, size_t len, uint16_t *segment,
+    struct sockaddr_storage *addr);
+
+//==>sharded sockets<==
+//total SO_REUSEPORT sockets on the same port, one per worker so each has its own accept
+//queue or receive buffer instead of every thread waking on one fd
+//with steer_cpu the kernel hands work to fds[cpu % total] so a worker pinned to that cpu
+//keeps the connection on the core that took the interrupt
+//tcp sockets are already listening, all return 0 or -1 and close what they made on error
+ITBDEF int itb_make_sharded_tcp(const char *port, int *fds, size_t total, bool steer_cpu);
+ITBDEF int itb_make_sharded_udp(int port, int *fds, size_t total, bool steer_cpu);
+//attach the cpu % total program to a reuseport group through any of its sockets
+ITBDEF int itb_attach_reuseport_cpu(int sfd, size_t total);
+//pins the calling thread to cpu
+ITBDEF int itb_pin_thread(int cpu);
+
 //==>epoll wrappers<==
 //wrappers for setting up and using epoll
 #define ITB_MAXEVENTS 256
@@ -124,15 +433,19 @@ ITBDEF ssize_t itb_send_message(
 #define ITB_EVENT_IN(events, i) (events[i].events & EPOLLIN)
 #define ITB_EVENT_ERR(events, i) (events[i].events & EPOLLERR)
 #define ITB_EVENT_HUP(events, i) (events[i].events & EPOLLHUP)
-#define ITB_EVENT_OUT(events, i) (events[i].events & EPOLLIN)
+#define ITB_EVENT_OUT(events, i) (events[i].events & EPOLLOUT)
 
 #define ITB_EVENT_FD(events, i) (events[i].data.fd)
 #define ITB_EVENT_PTR(events, i) (events[i].data.ptr)
 
 ITBDEF int itb_make_epoll();
+//ITB_MAXEVENTS sized
 ITBDEF struct epoll_event *itb_make_epoll_events();
 ITBDEF int itb_wait_epoll(int efd, struct epoll_event *events);
 ITBDEF int itb_wait_epoll_timeout(int efd, struct epoll_event *events, int timeout);
+//caller sized event arrays, timeout -1 blocks, returns 0 when interrupted or -1
+ITBDEF struct epoll_event *itb_make_epoll_events_n(size_t total);
+ITBDEF int itb_wait_epoll_n(int efd, struct epoll_event *events, int total, int timeout);
 ITBDEF int itb_add_epoll_ptr(int efd, int ifd, void *ptr);
 ITBDEF int itb_add_epoll_fd(int efd, int ifd);
 //if you want to still pass an int but its not the fd
@@ -143,6 +456,270 @@ ITBDEF int itb_add_epoll_afd(int efd, int ifd, int dt);
 ITBDEF int itb_add_epoll_ptr_flags(int efd, int ifd, void *ptr, int flags);
 ITBDEF int itb_add_epoll_fd_flags(int efd, int ifd, int flags);
 ITBDEF int itb_add_epoll_afd_flags(int efd, int ifd, int dt, int flags);
+//change interest without re-adding, eg switching between EPOLLIN and EPOLLOUT
+//fds added with EPOLLEXCLUSIVE can't be modified, use flags without it for those
+//these return -1 with errno set instead of exiting, the fd may already be gone
+ITBDEF int itb_mod_epoll_ptr_flags(int efd, int ifd, void *ptr, int flags);
+ITBDEF int itb_mod_epoll_fd_flags(int efd, int ifd, int flags);
+ITBDEF int itb_mod_epoll_afd_flags(int efd, int ifd, int dt, int flags);
+ITBDEF int itb_del_epoll(int efd, int ifd);
+
+//==>event loop<==
+//reactor over one epoll fd, handlers are registered by pointer and come back through
+//epoll_event.data.ptr so dispatch is a direct call
+//timers and handlers are owned by the caller and must stay valid while registered
+
+#ifndef ITB_LOOP_EVENTS
+#define ITB_LOOP_EVENTS 256
+#endif
+
+typedef struct itb_loop_t itb_loop_t;
+typedef struct itb_loop_handler_t itb_loop_handler_t;
+typedef struct itb_loop_timer_t itb_loop_timer_t;
+
+struct itb_loop_handler_t {
+    int fd;
+    //events is the epoll mask that fired
+    void (*func)(itb_loop_t *loop, itb_loop_handler_t *handler, uint32_t events);
+    void *data;
+};
+
+struct itb_loop_timer_t {
+    int64_t when;
+    //position in the heap, SIZE_MAX while not armed
+    size_t index;
+    void (*func)(itb_loop_t *loop, itb_loop_timer_t *timer);
+    void *data;
+};
+
+typedef struct {
+    void (*func)(itb_loop_t *loop, void *data);
+    void *data;
+} itb_loop_task_t;
+
+struct itb_loop_t {
+    int efd;
+    bool stopping;
+    //cached at the start of every pass
+    int64_t now;
+    struct epoll_event *events;
+    size_t total_events;
+    //events of the pass being dispatched, itb_loop_remove clears its handler out of them
+    int pending;
+    //min heap on when
+    itb_loop_timer_t **timers;
+    size_t total_timers;
+    size_t alloc_timers;
+    //deferred tasks can be queued from any thread, the eventfd wakes the loop for them
+    itb_loop_handler_t wake;
+    pthread_mutex_t mut;
+    itb_loop_task_t *tasks;
+    size_t total_tasks;
+    size_t alloc_tasks;
+    //swapped with tasks while they run so new ones can be queued
+    itb_loop_task_t *running;
+    size_t alloc_running;
+    //index into the loops of itb_loop_run_cores
+    size_t index;
+    void *data;
+};
+
+//total_events is how many events one epoll_wait can return, 0 for ITB_LOOP_EVENTS
+ITBDEF int itb_loop_init(itb_loop_t *loop, size_t total_events);
+//handlers still registered are not called, their fds are left open
+ITBDEF void itb_loop_close(itb_loop_t *loop);
+
+//events is an epoll mask like EPOLLIN | EPOLLET
+ITBDEF int itb_loop_add(itb_loop_t *loop, itb_loop_handler_t *handler, int fd, uint32_t events,
+    void (*func)(itb_loop_t *, itb_loop_handler_t *, uint32_t), void *data);
+ITBDEF int itb_loop_modify(itb_loop_t *loop, itb_loop_handler_t *handler, uint32_t events);
+//call before closing the fd
+ITBDEF int itb_loop_remove(itb_loop_t *loop, itb_loop_handler_t *handler);
+
+//fires once after ms, restarting an armed timer moves it
+ITBDEF int itb_loop_timer_start(itb_loop_t *loop, itb_loop_timer_t *timer, int64_t ms,
+    void (*func)(itb_loop_t *, itb_loop_timer_t *), void *data);
+ITBDEF void itb_loop_timer_stop(itb_loop_t *loop, itb_loop_timer_t *timer);
+ITBDEF void itb_loop_timer_init(itb_loop_timer_t *timer);
+
+//runs func on the loop thread after the current pass, safe from any thread
+ITBDEF int itb_loop_defer(itb_loop_t *loop, void (*func)(itb_loop_t *, void *), void *data);
+//interrupts epoll_wait, safe from any thread
+ITBDEF void itb_loop_wake(itb_loop_t *loop);
+//makes itb_loop_run return after the current pass, safe from any thread
+ITBDEF void itb_loop_stop(itb_loop_t *loop);
+
+//one pass, waits at most timeout ms or -1 until the next timer/event
+//returns how many handlers, timers and tasks ran or -1
+ITBDEF int itb_loop_run_once(itb_loop_t *loop, int timeout);
+ITBDEF int itb_loop_run(itb_loop_t *loop);
+
+//runs each initialized loop on its own thread pinned to cpu index % cpus
+//setup is called on the loop thread before it starts, eg to add a itb_make_sharded_tcp listener
+//returns once every loop was stopped
+ITBDEF int itb_loop_run_cores(itb_loop_t *loops, size_t total,
+    void (*setup)(itb_loop_t *loop, size_t index, void *data), void *data);
+
+//==>output queue<==
+//per connection send queue, small writes are coalesced into shared chunks and go out
+//together through writev on itb_outq_flush
+//while data is left over EPOLLOUT is added to the registration and dropped once it drains
+
+//writes up to this size are copied into a shared chunk, bigger ones are sent straight
+//away when nothing is queued
+#ifndef ITB_OUTQ_COALESCE
+#define ITB_OUTQ_COALESCE 4096
+#endif
+
+#ifndef ITB_OUTQ_CHUNK
+#define ITB_OUTQ_CHUNK 16384
+#endif
+
+//chunks handed to one writev
+#ifndef ITB_OUTQ_IOV
+#define ITB_OUTQ_IOV 64
+#endif
+
+#ifndef ITB_OUTQ_HIGH
+#define ITB_OUTQ_HIGH (1 << 20)
+#endif
+
+#ifndef ITB_OUTQ_LOW
+#define ITB_OUTQ_LOW (256 << 10)
+#endif
+
+typedef struct itb_outq_chunk_t {
+    struct itb_outq_chunk_t *next;
+    size_t start;
+    size_t len;
+    size_t size;
+    uint8_t data[];
+} itb_outq_chunk_t;
+
+typedef struct itb_outq_t {
+    int fd;
+    //epoll registration toggled for EPOLLOUT, efd -1 when not watched
+    int efd;
+    epoll_data_t epoll_data;
+    uint32_t events;
+    bool armed;
+    itb_outq_chunk_t *head;
+    itb_outq_chunk_t *tail;
+    //one drained chunk kept around so steady traffic doesn't malloc
+    itb_outq_chunk_t *spare;
+    size_t queued;
+    //backpressure, above high writes return 1 until a flush gets below low
+    size_t high;
+    size_t low;
+    bool above_high;
+    //called from itb_outq_flush when the queue drops below low after going above high
+    void (*on_low)(struct itb_outq_t *q);
+    void *data;
+} itb_outq_t;
+
+ITBDEF void itb_outq_init(itb_outq_t *q, int fd);
+//frees anything still queued, the fd is left open
+ITBDEF void itb_outq_close(itb_outq_t *q);
+//events is the normal interest of the fd, eg EPOLLIN, data must match what it was added with
+//for itb_loop_t pass loop->efd and (epoll_data_t){.ptr = handler}
+ITBDEF void itb_outq_watch(itb_outq_t *q, int efd, epoll_data_t data, uint32_t events);
+//0 queued or sent, 1 queued but above the high watermark, -1 out of memory or send error
+ITBDEF int itb_outq_write(itb_outq_t *q, const uint8_t *buffer, size_t len);
+//call after a batch of writes and whenever the fd reports EPOLLOUT
+//1 everything was sent, 0 data left and EPOLLOUT armed, -1 error and the connection is done
+ITBDEF int itb_outq_flush(itb_outq_t *q);
+
+#ifdef ITB_URING
+//==>io_uring<==
+//completion based alternative to the epoll wrappers, queue any number of operations and
+//hand them all to the kernel with one itb_uring_submit
+//data comes back as the completions user_data, see ITB_URING_DATA
+
+#ifndef ITB_URING_ENTRIES
+#define ITB_URING_ENTRIES 256
+#endif
+
+#define ITB_URING_DATA(cqe) ((void *)(uintptr_t)(cqe)->user_data)
+//multishot completions with this set will keep coming, without it the operation is done
+#define ITB_URING_MORE(cqe) ((cqe)->flags & IORING_CQE_F_MORE)
+
+typedef struct {
+    int fd;
+    unsigned features;
+    //submission ring, tail is ours until itb_uring_submit publishes it
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    unsigned sq_submitted;
+    struct io_uring_sqe *sqes;
+    //completion ring
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    //timeouts are read by the kernel on submit, one slot per sqe keeps them alive until then
+    struct __kernel_timespec *timeouts;
+    //mappings for close
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    //provided buffers for multishot recv
+    struct io_uring_buf_ring *buf_ring;
+    uint8_t *bufs;
+    unsigned buf_count;
+    unsigned buf_size;
+} itb_uring_t;
+
+//-1 with errno set to ENOSYS or EPERM when io_uring is missing or disabled, use epoll then
+ITBDEF int itb_uring_init(itb_uring_t *ring, unsigned entries);
+ITBDEF void itb_uring_close(itb_uring_t *ring);
+
+//these queue one operation, 0 or -1 when the submission queue is full and needs a submit
+//buffers and addresses must stay valid until the operation completes
+ITBDEF int itb_uring_accept(itb_uring_t *ring, int sfd, bool multishot, void *data);
+ITBDEF int itb_uring_connect(
+    itb_uring_t *ring, int sfd, const struct sockaddr_storage *addr, void *data);
+ITBDEF int itb_uring_recv(itb_uring_t *ring, int sfd, uint8_t *buffer, size_t len, void *data);
+ITBDEF int itb_uring_send(
+    itb_uring_t *ring, int sfd, const uint8_t *buffer, size_t len, void *data);
+//completes with -ETIME once ms passes
+ITBDEF int itb_uring_timeout(itb_uring_t *ring, uint64_t ms, void *data);
+
+//registered buffers skip the per operation page pinning, index is the position in iovs
+ITBDEF int itb_uring_register_buffers(itb_uring_t *ring, const struct iovec *iovs, unsigned total);
+ITBDEF int itb_uring_read_fixed(
+    itb_uring_t *ring, int fd, uint8_t *buffer, size_t len, unsigned index, void *data);
+ITBDEF int itb_uring_write_fixed(
+    itb_uring_t *ring, int fd, const uint8_t *buffer, size_t len, unsigned index, void *data);
+
+//multishot recv picks a buffer out of a ring of count buffers of size bytes for each completion
+//count must be a power of 2, set up once before queuing any itb_uring_recv_multishot
+ITBDEF int itb_uring_provide_buffers(itb_uring_t *ring, unsigned count, unsigned size);
+ITBDEF int itb_uring_recv_multishot(itb_uring_t *ring, int sfd, void *data);
+//the data of a multishot recv completion, hand it back with itb_uring_buffer_return when done
+ITBDEF uint8_t *itb_uring_buffer(itb_uring_t *ring, const struct io_uring_cqe *cqe);
+ITBDEF void itb_uring_buffer_return(itb_uring_t *ring, const struct io_uring_cqe *cqe);
+
+//submits everything queued and waits for at least wait completions
+//returns how many were submitted or - errno
+ITBDEF int itb_uring_submit(itb_uring_t *ring, unsigned wait);
+//the next completion or NULL, mark it handled with itb_uring_seen before peeking again
+ITBDEF struct io_uring_cqe *itb_uring_peek(itb_uring_t *ring);
+ITBDEF void itb_uring_seen(itb_uring_t *ring);
+#endif
+
+//==>string builder additions<==
+//only available when itb.h is included first
+#ifdef ITB_H
+//appends "a.b.c.d:port" or "[v6]:port" without going through a temporary string
+//returns 0 or -1 on an unknown family or out of memory
+ITBDEF int itb_strbuf_append_addr(itb_strbuf_t *sb, const struct sockaddr_storage *addr);
+#endif
 
 //so you dont need to link mbedtls but hey if you do, have some wrappers
 #ifdef ITB_SSL_ADDITIONS
@@ -177,10 +754,19 @@ ITBDEF void itb_ssl_cleanup(itb_ssl_conn_t *conn);
 #ifdef ITB_NET_IMPLEMENTATION
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 //==>extra wrappers<==
@@ -204,6 +790,13 @@ void itb_set_non_blocking(int sfd) {
 }
 #endif
 
+//monotonic milliseconds shared by connect deadlines, loop timers and resolver ttls
+static inline int64_t __itb_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 //==>tcp wrappers<==
 void itb_set_listening(int sfd) {
     itb_ensure(listen(sfd, SOMAXCONN) != -1);
@@ -296,14 +889,64 @@ int itb_accept_addr(int sfd, struct sockaddr_storage *addr) {
     return ret;
 }
 
+int itb_accept_all(int sfd,
+    int (*cb)(int fd, struct sockaddr_storage *addr, void *ctx), void *ctx, size_t max) {
+    size_t total = 0;
+    struct sockaddr_storage addr;
+
+    while (!max || total < max) {
+        socklen_t len = sizeof(struct sockaddr_storage);
+        //accept4 is a gnu extension
+        int fd = syscall(SYS_accept4, sfd, (struct sockaddr *)&addr, &len,
+            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            //the connection died in the backlog, there may be more behind it
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EAGAIN || total) {
+                break;
+            }
+            return -1;
+        }
+        ++total;
+        if (cb(fd, &addr, ctx) == -1) {
+            break;
+        }
+    }
+    return total;
+}
+
+int itb_set_listener_opts(int sfd, int opts) {
+    int enable = 1;
+    if ((opts & ITB_SOCK_NODELAY)
+        && setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int))) {
+        return -1;
+    }
+    if ((opts & ITB_SOCK_KEEPALIVE)
+        && setsockopt(sfd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int))) {
+        return -1;
+    }
+    //seconds to wait for data before handing the connection over anyway
+    int defer = 1;
+    if ((opts & ITB_SOCK_DEFER_ACCEPT)
+        && setsockopt(sfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(int))) {
+        return -1;
+    }
+    return 0;
+}
+
 ssize_t itb_recv(int sockfd, uint8_t *restrict buffer, size_t len) {
     ssize_t total = 0, ret;
-readmsg:
-    itb_ensure_nonblock((ret = recv(sockfd, buffer + total, len - total, 0)) != -1);
-    if (ret <= 0)
-        return total;
-    total += ret;
-    goto readmsg;
+    //a full buffer used to cost an extra 0 byte recv that looked like eof
+    while ((size_t)total < len) {
+        itb_ensure_nonblock((ret = recv(sockfd, buffer + total, len - total, 0)) != -1);
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
 }
 
 ssize_t itb_send(int sockfd, const uint8_t *restrict buffer, size_t len) {
@@ -312,235 +955,2201 @@ ssize_t itb_send(int sockfd, const uint8_t *restrict buffer, size_t len) {
     return ret;
 }
 
-//==>unix wrappers<==
-int itb_make_bound_unix(const char *path) {
-    int sfd;
-    itb_ensure(sfd = socket(AF_UNIX, SOCK_STREAM, 0));
+void itb_iov_advance(struct iovec **iov, int *iovcnt, size_t len) {
+    //>= so empty entries are dropped along the way
+    struct iovec *cur = *iov;
+    int left          = *iovcnt;
+    while (left && len >= cur->iov_len) {
+        len -= cur->iov_len;
+        ++cur;
+        --left;
+    }
+    if (left && len) {
+        cur->iov_base = (uint8_t *)cur->iov_base + len;
+        cur->iov_len -= len;
+    }
+    *iov    = cur;
+    *iovcnt = left;
+}
 
-    struct sockaddr_un su;
-    memset(&su, 0, sizeof(struct sockaddr_un));
-    su.sun_family = AF_UNIX;
-    strcpy(su.sun_path, path);
+//the kernels UIO_MAXIOV, IOV_MAX is hidden without _XOPEN_SOURCE
+#define ITB_IOV_MAX 1024
 
-    unlink(path);
-    itb_ensure(bind(sfd, (struct sockaddr *)&su, sizeof(struct sockaddr_un)) != -1);
+//one sendmsg/recvmsg worth of the cursor, the kernel rejects more than ITB_IOV_MAX entries
+static inline ssize_t __itb_iov_io(int sockfd, struct iovec *iov, int iovcnt, bool out) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(struct msghdr));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = iovcnt < ITB_IOV_MAX ? iovcnt : ITB_IOV_MAX;
 
-    return sfd;
+    ssize_t ret;
+    do {
+        ret = out ? sendmsg(sockfd, &msg, MSG_NOSIGNAL) : recvmsg(sockfd, &msg, 0);
+        if (ret == -1 && errno == ENOTSOCK) {
+            ret = out ? writev(sockfd, iov, msg.msg_iovlen) : readv(sockfd, iov, msg.msg_iovlen);
+        }
+    } while (ret == -1 && errno == EINTR);
+    return ret;
 }
 
-int itb_make_connected_unix(const char *path) {
-    int sfd;
-    itb_ensure(sfd = socket(AF_UNIX, SOCK_STREAM, 0));
+ssize_t itb_sendv(int sockfd, struct iovec **iov, int *iovcnt) {
+    size_t total = 0;
+    //leading empty entries would make a 0 byte transfer look like a full socket or eof
+    itb_iov_advance(iov, iovcnt, 0);
+    while (*iovcnt) {
+        ssize_t ret = __itb_iov_io(sockfd, *iov, *iovcnt, true);
+        if (ret == -1) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        itb_iov_advance(iov, iovcnt, ret);
+        total += ret;
+    }
+    return total;
+}
 
-    struct sockaddr_un su;
-    memset(&su, 0, sizeof(struct sockaddr_un));
-    su.sun_family = AF_UNIX;
-    strcpy(su.sun_path, path);
+ssize_t itb_recvv(int sockfd, struct iovec **iov, int *iovcnt) {
+    size_t total = 0;
+    itb_iov_advance(iov, iovcnt, 0);
+    while (*iovcnt) {
+        ssize_t ret = __itb_iov_io(sockfd, *iov, *iovcnt, false);
+        if (ret == -1) {
+            if (errno == EAGAIN && total) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        if (ret == 0) {
+            break;
+        }
+        itb_iov_advance(iov, iovcnt, ret);
+        total += ret;
+    }
+    return total;
+}
 
-    itb_ensure(connect(sfd, (struct sockaddr *)&su, sizeof(struct sockaddr_un)) != -1);
+//==>async connect<==
+int itb_connect_start_addrs(itb_connect_t *conn, const struct sockaddr_storage *addrs,
+    size_t total, int stagger_ms, int timeout_ms) {
+    memset(conn, 0, sizeof(itb_connect_t));
+    conn->fd         = -1;
+    conn->stagger_ms = stagger_ms ? stagger_ms : ITB_CONNECT_STAGGER;
+    conn->deadline   = __itb_now_ms() + timeout_ms;
+    conn->error      = ECONNREFUSED;
+
+    if (total > ITB_CONNECT_MAX_ADDRS) {
+        total = ITB_CONNECT_MAX_ADDRS;
+    }
+    for (size_t i = 0; i < ITB_CONNECT_MAX_ADDRS; ++i) {
+        conn->fds[i] = -1;
+    }
+    for (size_t i = 0; i < total; ++i) {
+        conn->addrs[i]     = addrs[i];
+        conn->addr_lens[i] = addrs[i].ss_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                                            : sizeof(struct sockaddr_in);
+    }
+    conn->total_addrs = total;
 
-    return sfd;
+    if ((conn->efd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        return -1;
+    }
+    //the first attempt goes out right away
+    if (itb_connect_poll(conn, 0) == -1) {
+        int error = errno;
+        itb_connect_close(conn);
+        errno = error;
+        return -1;
+    }
+    return 0;
 }
 
-//==>ip wrappers<==
-void itb_make_storage(struct sockaddr_storage *restrict addr, const char *restrict host, int port) {
+int itb_connect_start(
+    itb_connect_t *conn, const char *host, const char *port, int stagger_ms, int timeout_ms) {
     struct addrinfo hints;
-    struct addrinfo *rp;
-
+    struct addrinfo *result, *rp;
     memset(&hints, 0, sizeof(struct addrinfo));
     hints.ai_family   = AF_UNSPEC;
-    hints.ai_socktype = SOCK_DGRAM;
-    hints.ai_flags    = AI_PASSIVE; // All interfaces
-
-    //null the service as it only accepts strings and we have the port already
-    itb_ensure(getaddrinfo(host, NULL, &hints, &rp) == 0);
+    hints.ai_socktype = SOCK_STREAM;
 
-    //assuming the first result returned will be correct
-    //TODO find a way to check
-    itb_ensure(rp);
+    //safe to itb_connect_close even when resolving fails
+    memset(conn, 0, sizeof(itb_connect_t));
+    conn->efd = conn->fd = -1;
 
-    //add the port manually
-    if (rp->ai_family == AF_INET) {
-        ((struct sockaddr_in *)rp->ai_addr)->sin_port = htons(port);
-    } else if (rp->ai_family == AF_INET6) {
-        ((struct sockaddr_in6 *)rp->ai_addr)->sin6_port = htons(port);
+    int ret;
+    if ((ret = getaddrinfo(host, port, &hints, &result))) {
+        return ret < 0 ? ret : -1;
     }
 
-    memcpy(addr, rp->ai_addr, rp->ai_addrlen);
+    //interleave the families so a broken ipv6 path costs one stagger and not all of them
+    struct sockaddr_storage v6[ITB_CONNECT_MAX_ADDRS], v4[ITB_CONNECT_MAX_ADDRS];
+    struct sockaddr_storage addrs[ITB_CONNECT_MAX_ADDRS];
+    size_t total_v6 = 0, total_v4 = 0, total = 0;
+    for (rp = result; rp != NULL; rp = rp->ai_next) {
+        if (rp->ai_family == AF_INET6 && total_v6 < ITB_CONNECT_MAX_ADDRS) {
+            memcpy(v6 + total_v6++, rp->ai_addr, rp->ai_addrlen);
+        } else if (rp->ai_family == AF_INET && total_v4 < ITB_CONNECT_MAX_ADDRS) {
+            memcpy(v4 + total_v4++, rp->ai_addr, rp->ai_addrlen);
+        }
+    }
+    freeaddrinfo(result);
+    for (size_t i = 0; total < ITB_CONNECT_MAX_ADDRS && (i < total_v6 || i < total_v4); ++i) {
+        if (i < total_v6) {
+            addrs[total++] = v6[i];
+        }
+        if (i < total_v4 && total < ITB_CONNECT_MAX_ADDRS) {
+            addrs[total++] = v4[i];
+        }
+    }
 
-    freeaddrinfo(rp);
+    return itb_connect_start_addrs(conn, addrs, total, stagger_ms, timeout_ms);
 }
 
-int itb_print_addr(char **buff, struct sockaddr_storage *addr) {
-    //if NULL allocate it
-    char sbuf[NI_MAXSERV];
-    if (*buff || (*buff = malloc(NI_MAXHOST))) {
-        return getnameinfo((const struct sockaddr *)addr, sizeof(struct sockaddr_storage), *buff,
-            NI_MAXHOST, sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV);
+//starts attempts until one is in flight or the addresses run out
+static void __itb_connect_next(itb_connect_t *conn, int64_t now) {
+    while (conn->next_addr < conn->total_addrs) {
+        const size_t i = conn->next_addr++;
+        const int type = SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC;
+        int fd;
+        if ((fd = socket(conn->addrs[i].ss_family, type, 0)) == -1) {
+            conn->error = errno;
+            continue;
+        }
+
+        int ret;
+        do {
+            ret = connect(fd, (struct sockaddr *)(conn->addrs + i), conn->addr_lens[i]);
+        } while (ret == -1 && errno == EINTR);
+
+        //loopback can finish straight away, it still gets reported through efd
+        if (ret == -1 && errno != EINPROGRESS) {
+            conn->error = errno;
+            close(fd);
+            continue;
+        }
+        struct epoll_event event;
+        event.events   = EPOLLOUT;
+        event.data.u64 = i;
+        if (epoll_ctl(conn->efd, EPOLL_CTL_ADD, fd, &event)) {
+            conn->error = errno;
+            close(fd);
+            continue;
+        }
+        conn->fds[i] = fd;
+        ++conn->in_flight;
+        conn->next_start = now + conn->stagger_ms;
+        return;
     }
+}
 
-    return 1;
+int itb_connect_timeout(const itb_connect_t *conn) {
+    int64_t now   = __itb_now_ms();
+    int64_t until = conn->deadline - now;
+    if (conn->next_addr < conn->total_addrs && conn->next_start - now < until) {
+        until = conn->next_start - now;
+    }
+    return until < 0 ? 0 : until > INT32_MAX ? INT32_MAX : until;
 }
 
-//==>udp wrappers<==
-int itb_make_bound_udp(int port) {
-    struct sockaddr_in sin;
-    int sockfd;
+int itb_connect_poll(itb_connect_t *conn, int timeout) {
+    struct epoll_event events[ITB_CONNECT_MAX_ADDRS];
+    if (conn->fd != -1) {
+        return 1;
+    }
 
-    itb_ensure((sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) != -1);
+    const int64_t stop = timeout >= 0 ? __itb_now_ms() + timeout : INT64_MAX;
+    for (;;) {
+        int64_t now = __itb_now_ms();
+        if (now >= conn->deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (!conn->in_flight || now >= conn->next_start) {
+            __itb_connect_next(conn, now);
+        }
+        if (!conn->in_flight) {
+            errno = conn->error;
+            return -1;
+        }
 
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port        = htons(port);
-    sin.sin_family      = AF_INET;
+        //wake up for whichever comes first, the callers timeout, the next attempt or the deadline
+        int wait = itb_connect_timeout(conn);
+        if (stop - now < wait) {
+            wait = stop > now ? stop - now : 0;
+        }
+        int total = epoll_wait(conn->efd, events, ITB_CONNECT_MAX_ADDRS, wait);
+        if (total == -1 && errno != EINTR) {
+            return -1;
+        }
 
-    int enable = 1;
-    itb_ensure(setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) != -1);
-    itb_ensure(bind(sockfd, (struct sockaddr *)&sin, sizeof(sin)) != -1);
+        for (int e = 0; e < total; ++e) {
+            const size_t i = events[e].data.u64;
+            int error      = 0;
+            socklen_t len  = sizeof(int);
+            getsockopt(conn->fds[i], SOL_SOCKET, SO_ERROR, &error, &len);
+            itb_del_epoll(conn->efd, conn->fds[i]);
+            --conn->in_flight;
+
+            if (!error) {
+                conn->fd     = conn->fds[i];
+                conn->fds[i] = -1;
+                return 1;
+            }
+            conn->error = error;
+            close(conn->fds[i]);
+            conn->fds[i] = -1;
+            //a failure doesn't have to wait out the stagger
+            conn->next_start = now;
+        }
 
-    return sockfd;
+        if (total <= 0 && __itb_now_ms() >= stop) {
+            return 0;
+        }
+    }
 }
 
-int itb_make_udp(void) {
-    int sfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
-    return sfd;
+void itb_connect_close(itb_connect_t *conn) {
+    for (size_t i = 0; i < conn->total_addrs; ++i) {
+        if (conn->fds[i] != -1) {
+            close(conn->fds[i]);
+            conn->fds[i] = -1;
+        }
+    }
+    conn->in_flight = 0;
+    if (conn->efd != -1) {
+        close(conn->efd);
+        conn->efd = -1;
+    }
 }
 
-ssize_t itb_read_message(int sockfd, uint8_t *restrict buffer, size_t len) {
-    ssize_t total = 0, ret;
-readmsg:
-    itb_ensure_nonblock((ret = recvfrom(sockfd, buffer + total, len - total, 0, NULL, NULL)) != -1);
-    if (ret == -1)
-        return total;
-    total += ret;
-    goto readmsg;
+int itb_make_connected_timeout(const char *host, const char *port, int timeout_ms) {
+    itb_connect_t conn;
+    int ret;
+    if (itb_connect_start(&conn, host, port, 0, timeout_ms)) {
+        return -1;
+    }
+    while (!(ret = itb_connect_poll(&conn, -1))) {
+    }
+    itb_connect_close(&conn);
+    return ret == 1 ? conn.fd : -1;
 }
 
-ssize_t itb_read_message_port(int sockfd, uint8_t *restrict buffer, size_t len, int *restrict port) {
-    struct sockaddr_storage addr;
-    socklen_t addr_len;
-    char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
-    ssize_t total = 0, ret;
-readmsg:
-    addr_len = sizeof(struct sockaddr_storage);
-    itb_ensure_nonblock((ret = recvfrom(sockfd, buffer + total, len - total, 0,
-                             (struct sockaddr *)&addr, &addr_len))
-        != -1);
-    if (ret == -1)
-        return total;
-    total += ret;
-    itb_ensure(getnameinfo((struct sockaddr *)&addr, addr_len, hbuf, sizeof(hbuf), sbuf,
-                   sizeof(hbuf), NI_NUMERICHOST | NI_NUMERICSERV | NI_DGRAM)
-        == 0);
-    *port = atoi(sbuf);
-    goto readmsg;
+//==>bounded receives<==
+static inline itb_recv_status_t __itb_recv_status(ssize_t ret) {
+    if (ret == 0) {
+        return ITB_RECV_EOF;
+    }
+    return errno == EAGAIN ? ITB_RECV_AGAIN : ITB_RECV_ERROR;
 }
 
-ssize_t itb_read_message_addr(
-    int sockfd, uint8_t *restrict buffer, size_t len, struct sockaddr_storage *addr) {
-    socklen_t addr_len;
-    ssize_t total = 0, ret;
-readmsg:
-    addr_len = sizeof(struct sockaddr_storage);
-    itb_ensure_nonblock(
-        (ret = recvfrom(sockfd, buffer + total, len - total, 0, (struct sockaddr *)addr, &addr_len))
-        != -1);
-    if (ret == -1)
-        return total;
-    total += ret;
-    goto readmsg;
+itb_recv_status_t itb_recv_bounded(
+    int sockfd, uint8_t *buffer, size_t len, size_t *got, int max_calls) {
+    size_t total             = 0;
+    int calls                = 0;
+    itb_recv_status_t status = ITB_RECV_FULL;
+
+    while (total < len) {
+        if (max_calls && calls++ == max_calls) {
+            status = ITB_RECV_LIMIT;
+            break;
+        }
+        ssize_t ret = recv(sockfd, buffer + total, len - total, 0);
+        if (ret > 0) {
+            total += ret;
+            continue;
+        }
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        status = __itb_recv_status(ret);
+        break;
+    }
+    *got = total;
+    return status;
 }
 
-ssize_t itb_send_message(int sockfd, const uint8_t *restrict buffer, size_t len,
-    const struct sockaddr_storage *restrict addr) {
-    ssize_t ret;
+int itb_recv_ring_init(itb_recv_ring_t *ring, size_t size) {
+    ring->head = ring->tail = 0;
+    ring->size              = size;
+    if (!size || (size & (size - 1))) {
+        ring->buffer = NULL;
+        return -1;
+    }
+    return (ring->buffer = malloc(size)) ? 0 : -1;
+}
+
+void itb_recv_ring_close(itb_recv_ring_t *ring) {
+    free(ring->buffer);
+    ring->buffer = NULL;
+    ring->head = ring->tail = 0;
+}
+
+itb_recv_status_t itb_recv_ring(int sockfd, itb_recv_ring_t *ring, size_t *got, int max_calls) {
+    size_t total             = 0;
+    int calls                = 0;
+    itb_recv_status_t status = ITB_RECV_FULL;
+
+    for (;;) {
+        const size_t used = ring->tail - ring->head;
+        if (used == ring->size) {
+            break;
+        }
+        if (max_calls && calls++ == max_calls) {
+            status = ITB_RECV_LIMIT;
+            break;
+        }
+
+        //the free space is at most two pieces, the end of the buffer and its start
+        const size_t at = ring->tail & (ring->size - 1);
+        size_t first    = ring->size - at;
+        if (first > ring->size - used) {
+            first = ring->size - used;
+        }
+        struct iovec iovs[2] = {
+            {ring->buffer + at, first},
+            {ring->buffer, ring->size - used - first},
+        };
+        ssize_t ret = readv(sockfd, iovs, iovs[1].iov_len ? 2 : 1);
+        if (ret > 0) {
+            ring->tail += ret;
+            total += ret;
+            continue;
+        }
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        status = __itb_recv_status(ret);
+        break;
+    }
+    *got = total;
+    return status;
+}
+
+uint8_t *itb_recv_ring_peek(itb_recv_ring_t *ring, size_t *len) {
+    const size_t at   = ring->head & (ring->size - 1);
+    const size_t used = ring->tail - ring->head;
+    *len              = used < ring->size - at ? used : ring->size - at;
+    return ring->buffer + at;
+}
+
+void itb_recv_ring_consume(itb_recv_ring_t *ring, size_t len) {
+    ring->head += len;
+}
+
+//==>file transmission<==
+//splice is a gnu extension so the flags and call might be hidden
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE 1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE 4
+#endif
+
+ssize_t itb_sendfile(int sockfd, int fd, off_t *off, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t ret = sendfile(sockfd, fd, off, len - total);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        //fd ended before len
+        if (ret == 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+int itb_splicer_init(itb_splicer_t *splicer) {
+    splicer->pending = 0;
+    splicer->eof     = false;
+    if (pipe(splicer->pipe)) {
+        return -1;
+    }
+    for (size_t i = 0; i < 2; ++i) {
+        itb_set_non_blocking(splicer->pipe[i]);
+        fcntl(splicer->pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+}
+
+void itb_splicer_close(itb_splicer_t *splicer) {
+    close(splicer->pipe[0]);
+    close(splicer->pipe[1]);
+    splicer->pending = 0;
+}
+
+static inline ssize_t __itb_splice(int fd_in, off_t *off_in, int fd_out, size_t len, unsigned flags) {
+    ssize_t ret;
+    do {
+        ret = syscall(SYS_splice, fd_in, off_in, fd_out, NULL, len, flags);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+ssize_t itb_splice(itb_splicer_t *splicer, int fd_in, off_t *off_in, int fd_out, size_t len) {
+    const unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+    size_t total         = 0;
+
+    for (;;) {
+        //fill the pipe first so there is something to hand fd_out
+        if (len) {
+            ssize_t in = __itb_splice(fd_in, off_in, splicer->pipe[1], len, flags);
+            if (in > 0) {
+                splicer->pending += in;
+                len -= in;
+            } else if (in == 0) {
+                splicer->eof = true;
+                len          = 0;
+            } else if (in == -1 && errno != EAGAIN) {
+                return total ? (ssize_t)total : -1;
+            } else if (!splicer->pending) {
+                //fd_in has nothing right now
+                break;
+            }
+        }
+        if (!splicer->pending) {
+            break;
+        }
+
+        ssize_t out = __itb_splice(splicer->pipe[0], NULL, fd_out, splicer->pending,
+            flags | (len ? SPLICE_F_MORE : 0));
+        if (out == -1) {
+            if (errno == EAGAIN) {
+                break;
+            }
+            return total ? (ssize_t)total : -1;
+        }
+        splicer->pending -= out;
+        total += out;
+    }
+    return total;
+}
+
+//==>zero copy sends<==
+int itb_enable_zerocopy(int sockfd) {
+    int enable = 1;
+    return setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(int)) ? -1 : 0;
+}
+
+void itb_zerocopy_init(itb_zerocopy_t *zc, void (*release)(void *data)) {
+    memset(zc, 0, sizeof(itb_zerocopy_t));
+    zc->release = release;
+}
+
+size_t itb_zerocopy_outstanding(const itb_zerocopy_t *zc) {
+    return zc->tail - zc->head;
+}
+
+ssize_t itb_send_zerocopy(
+    itb_zerocopy_t *zc, int sockfd, const uint8_t *buffer, size_t len, void *data) {
+    if (zc->tail - zc->head >= ITB_ZEROCOPY_MAX) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ssize_t ret;
+    do {
+        ret = send(sockfd, buffer, len, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    } while (ret == -1 && errno == EINTR);
+    //failed sends don't take a sequence number
+    if (ret == -1) {
+        return -1;
+    }
+    zc->pending[zc->tail++ & (ITB_ZEROCOPY_MAX - 1)] = data;
+    return ret;
+}
+
+int itb_zerocopy_complete(itb_zerocopy_t *zc, int sockfd) {
+    int total = 0;
+    for (;;) {
+        uint8_t control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            return total ? total : -1;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                    || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cmsg), sizeof(struct sock_extended_err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno) {
+                continue;
+            }
+
+            //ee_info to ee_data is an inclusive range of send numbers, it can wrap
+            const uint32_t hi = err.ee_data + 1;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                zc->copied += hi - err.ee_info;
+            }
+            //ranges arrive in order so everything up to hi is done
+            while ((int32_t)(hi - zc->head) > 0 && zc->head != zc->tail) {
+                void *data = zc->pending[zc->head++ & (ITB_ZEROCOPY_MAX - 1)];
+                if (zc->release) {
+                    zc->release(data);
+                }
+                ++zc->completed;
+                ++total;
+            }
+        }
+    }
+    return total;
+}
+
+//==>unix wrappers<==
+int itb_make_bound_unix(const char *path) {
+    int sfd;
+    itb_ensure(sfd = socket(AF_UNIX, SOCK_STREAM, 0));
+
+    struct sockaddr_un su;
+    memset(&su, 0, sizeof(struct sockaddr_un));
+    su.sun_family = AF_UNIX;
+    strcpy(su.sun_path, path);
+
+    unlink(path);
+    itb_ensure(bind(sfd, (struct sockaddr *)&su, sizeof(struct sockaddr_un)) != -1);
+
+    return sfd;
+}
+
+int itb_make_connected_unix(const char *path) {
+    int sfd;
+    itb_ensure(sfd = socket(AF_UNIX, SOCK_STREAM, 0));
+
+    struct sockaddr_un su;
+    memset(&su, 0, sizeof(struct sockaddr_un));
+    su.sun_family = AF_UNIX;
+    strcpy(su.sun_path, path);
+
+    itb_ensure(connect(sfd, (struct sockaddr *)&su, sizeof(struct sockaddr_un)) != -1);
+
+    return sfd;
+}
+
+//==>ip wrappers<==
+void itb_make_storage(struct sockaddr_storage *restrict addr, const char *restrict host, int port) {
+    struct addrinfo hints;
+    struct addrinfo *rp;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_PASSIVE; // All interfaces
+
+    //null the service as it only accepts strings and we have the port already
+    itb_ensure(getaddrinfo(host, NULL, &hints, &rp) == 0);
+
+    //assuming the first result returned will be correct
+    //TODO find a way to check
+    itb_ensure(rp);
+
+    //add the port manually
+    if (rp->ai_family == AF_INET) {
+        ((struct sockaddr_in *)rp->ai_addr)->sin_port = htons(port);
+    } else if (rp->ai_family == AF_INET6) {
+        ((struct sockaddr_in6 *)rp->ai_addr)->sin6_port = htons(port);
+    }
+
+    memcpy(addr, rp->ai_addr, rp->ai_addrlen);
+
+    freeaddrinfo(rp);
+}
+
+int itb_print_addr(char **buff, struct sockaddr_storage *addr) {
+    //if NULL allocate it
+    char sbuf[NI_MAXSERV];
+    if (*buff || (*buff = malloc(NI_MAXHOST))) {
+        return getnameinfo((const struct sockaddr *)addr, sizeof(struct sockaddr_storage), *buff,
+            NI_MAXHOST, sbuf, sizeof(sbuf), NI_NUMERICHOST | NI_NUMERICSERV);
+    }
+
+    return 1;
+}
+
+//==>udp wrappers<==
+static int __itb_udp_opts(int sockfd, int opts) {
+    int value = 0;
+    //a segment size of 0 leaves sends alone but tells us the kernel knows the option
+    if ((opts & ITB_UDP_GSO)
+        && setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &value, sizeof(int)) == -1) {
+        return -1;
+    }
+    value = 1;
+    if ((opts & ITB_UDP_GRO) && setsockopt(sockfd, SOL_UDP, UDP_GRO, &value, sizeof(int)) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+int itb_make_bound_udp(int port) {
+    return itb_make_bound_udp_opts(port, 0);
+}
+
+int itb_make_bound_udp_opts(int port, int opts) {
+    struct sockaddr_in sin;
+    int sockfd;
+
+    itb_ensure((sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) != -1);
+    if (__itb_udp_opts(sockfd, opts)) {
+        close(sockfd);
+        return -1;
+    }
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port        = htons(port);
+    sin.sin_family      = AF_INET;
+
+    int enable = 1;
+    itb_ensure(setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) != -1);
+    itb_ensure(bind(sockfd, (struct sockaddr *)&sin, sizeof(sin)) != -1);
+
+    return sockfd;
+}
+
+int itb_make_udp(void) {
+    return itb_make_udp_opts(0);
+}
+
+int itb_make_udp_opts(int opts) {
+    int sfd;
+    if ((sfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) != -1 && __itb_udp_opts(sfd, opts)) {
+        close(sfd);
+        return -1;
+    }
+    return sfd;
+}
+
+ssize_t itb_read_message(int sockfd, uint8_t *restrict buffer, size_t len) {
+    ssize_t total = 0, ret;
+readmsg:
+    itb_ensure_nonblock((ret = recvfrom(sockfd, buffer + total, len - total, 0, NULL, NULL)) != -1);
+    if (ret == -1)
+        return total;
+    total += ret;
+    goto readmsg;
+}
+
+ssize_t itb_read_message_port(int sockfd, uint8_t *restrict buffer, size_t len, int *restrict port) {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
+    ssize_t total = 0, ret;
+readmsg:
+    addr_len = sizeof(struct sockaddr_storage);
+    itb_ensure_nonblock((ret = recvfrom(sockfd, buffer + total, len - total, 0,
+                             (struct sockaddr *)&addr, &addr_len))
+        != -1);
+    if (ret == -1)
+        return total;
+    total += ret;
+    itb_ensure(getnameinfo((struct sockaddr *)&addr, addr_len, hbuf, sizeof(hbuf), sbuf,
+                   sizeof(hbuf), NI_NUMERICHOST | NI_NUMERICSERV | NI_DGRAM)
+        == 0);
+    *port = atoi(sbuf);
+    goto readmsg;
+}
+
+ssize_t itb_read_message_addr(
+    int sockfd, uint8_t *restrict buffer, size_t len, struct sockaddr_storage *addr) {
+    socklen_t addr_len;
+    ssize_t total = 0, ret;
+readmsg:
+    addr_len = sizeof(struct sockaddr_storage);
+    itb_ensure_nonblock(
+        (ret = recvfrom(sockfd, buffer + total, len - total, 0, (struct sockaddr *)addr, &addr_len))
+        != -1);
+    if (ret == -1)
+        return total;
+    total += ret;
+    goto readmsg;
+}
+
+ssize_t itb_send_message(int sockfd, const uint8_t *restrict buffer, size_t len,
+    const struct sockaddr_storage *restrict addr) {
+    ssize_t ret;
     socklen_t addr_len = sizeof(struct sockaddr_storage);
     itb_ensure_nonblock(
         (ret = sendto(sockfd, buffer, len, 0, (struct sockaddr *)addr, addr_len)) != -1);
     return ret;
 }
 
-//==>epoll wrappers<==
-struct epoll_event *itb_make_epoll_events() {
-    return (struct epoll_event *)malloc(sizeof(struct epoll_event) * ITB_MAXEVENTS);
+//struct mmsghdr and the libc wrappers need _GNU_SOURCE, the layout is fixed by the kernel
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+} itb_mmsghdr_t;
+
+static inline int __itb_recvmmsg(int sockfd, itb_mmsghdr_t *hdrs, unsigned int vlen, int flags) {
+    return syscall(SYS_recvmmsg, sockfd, hdrs, vlen, flags, NULL);
+}
+
+static inline int __itb_sendmmsg(int sockfd, itb_mmsghdr_t *hdrs, unsigned int vlen, int flags) {
+    return syscall(SYS_sendmmsg, sockfd, hdrs, vlen, flags);
+}
+
+int itb_read_messages(int sockfd, itb_message_t *msgs, size_t total) {
+    itb_mmsghdr_t hdrs[ITB_MMSG_MAX];
+    struct iovec iovs[ITB_MMSG_MAX];
+    size_t done = 0;
+
+    while (done < total) {
+        const size_t batch = total - done < ITB_MMSG_MAX ? total - done : ITB_MMSG_MAX;
+        itb_message_t *msg = msgs + done;
+
+        for (size_t i = 0; i < batch; ++i) {
+            iovs[i].iov_base               = msg[i].buffer;
+            iovs[i].iov_len                = msg[i].size;
+            hdrs[i].msg_hdr.msg_name       = msg[i].addr;
+            hdrs[i].msg_hdr.msg_namelen    = msg[i].addr ? sizeof(struct sockaddr_storage) : 0;
+            hdrs[i].msg_hdr.msg_iov        = iovs + i;
+            hdrs[i].msg_hdr.msg_iovlen     = 1;
+            hdrs[i].msg_hdr.msg_control    = NULL;
+            hdrs[i].msg_hdr.msg_controllen = 0;
+            hdrs[i].msg_hdr.msg_flags      = 0;
+        }
+
+        int ret;
+        itb_ensure_nonblock((ret = __itb_recvmmsg(sockfd, hdrs, batch, MSG_DONTWAIT)) != -1);
+        if (ret == -1) {
+            break;
+        }
+
+        for (int i = 0; i < ret; ++i) {
+            msg[i].len   = hdrs[i].msg_len;
+            msg[i].flags = hdrs[i].msg_hdr.msg_flags;
+        }
+        done += ret;
+
+        //the queue ran dry
+        if ((size_t)ret < batch) {
+            break;
+        }
+    }
+    return done;
+}
+
+int itb_send_messages(int sockfd, const itb_message_t *msgs, size_t total) {
+    itb_mmsghdr_t hdrs[ITB_MMSG_MAX];
+    struct iovec iovs[ITB_MMSG_MAX];
+    size_t done = 0;
+
+    while (done < total) {
+        const size_t batch       = total - done < ITB_MMSG_MAX ? total - done : ITB_MMSG_MAX;
+        const itb_message_t *msg = msgs + done;
+
+        for (size_t i = 0; i < batch; ++i) {
+            iovs[i].iov_base               = msg[i].buffer;
+            iovs[i].iov_len                = msg[i].len;
+            hdrs[i].msg_hdr.msg_name       = msg[i].addr;
+            hdrs[i].msg_hdr.msg_namelen    = msg[i].addr ? sizeof(struct sockaddr_storage) : 0;
+            hdrs[i].msg_hdr.msg_iov        = iovs + i;
+            hdrs[i].msg_hdr.msg_iovlen     = 1;
+            hdrs[i].msg_hdr.msg_control    = NULL;
+            hdrs[i].msg_hdr.msg_controllen = 0;
+            hdrs[i].msg_hdr.msg_flags      = 0;
+        }
+
+        int ret;
+        itb_ensure_nonblock((ret = __itb_sendmmsg(sockfd, hdrs, batch, MSG_DONTWAIT)) != -1);
+        if (ret == -1) {
+            break;
+        }
+        done += ret;
+
+        //the socket buffer filled up
+        if ((size_t)ret < batch) {
+            break;
+        }
+    }
+    return done;
+}
+
+//the kernel caps a gso send at 64 segments
+#define ITB_UDP_GSO_SEGMENTS 64
+
+//one datagram per segment through sendmmsg for sockets without gso
+static ssize_t __itb_send_segments_mmsg(int sockfd, const uint8_t *buffer, size_t len,
+    uint16_t segment, const struct sockaddr_storage *addr) {
+    itb_message_t msgs[ITB_MMSG_MAX];
+    size_t total = 0;
+    while (total < len) {
+        size_t count = 0, off = total;
+        for (; count < ITB_MMSG_MAX && off < len; ++count) {
+            msgs[count].buffer = (uint8_t *)buffer + off;
+            msgs[count].len    = len - off < segment ? len - off : segment;
+            msgs[count].addr   = (struct sockaddr_storage *)addr;
+            off += msgs[count].len;
+        }
+        const int sent = itb_send_messages(sockfd, msgs, count);
+        for (int i = 0; i < sent; ++i) {
+            total += msgs[i].len;
+        }
+        if ((size_t)sent < count) {
+            break;
+        }
+    }
+    return total;
+}
+
+ssize_t itb_send_segments(int sockfd, const uint8_t *buffer, size_t len, uint16_t segment,
+    const struct sockaddr_storage *addr) {
+    //a segment bigger than the largest datagram would leave a 0 byte chunk and never finish
+    if (!segment || segment > ITB_UDP_SEGMENTS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    //as many whole segments as fit in one gso send
+    size_t chunk = ITB_UDP_SEGMENTS_MAX / segment;
+    if (chunk > ITB_UDP_GSO_SEGMENTS) {
+        chunk = ITB_UDP_GSO_SEGMENTS;
+    }
+    chunk *= segment;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    struct iovec iov;
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(struct msghdr));
+    hdr.msg_name       = (void *)addr;
+    hdr.msg_namelen    = addr ? sizeof(struct sockaddr_storage) : 0;
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = control;
+    hdr.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr);
+    cm->cmsg_level     = SOL_UDP;
+    cm->cmsg_type      = UDP_SEGMENT;
+    cm->cmsg_len       = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &segment, sizeof(uint16_t));
+
+    size_t total = 0;
+    while (total < len) {
+        iov.iov_base = (void *)(buffer + total);
+        iov.iov_len  = len - total < chunk ? len - total : chunk;
+
+        ssize_t ret = sendmsg(sockfd, &hdr, MSG_DONTWAIT);
+        //no gso on this socket or route, EIO is what a device without checksum offload gives
+        if (ret == -1 && (errno == EINVAL || errno == ENOPROTOOPT || errno == EIO)) {
+            return total
+                   + __itb_send_segments_mmsg(sockfd, buffer + total, len - total, segment, addr);
+        }
+        itb_ensure_nonblock(ret != -1);
+        if (ret == -1) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+ssize_t itb_read_segments(int sockfd, uint8_t *buffer, size_t len, uint16_t *segment,
+    struct sockaddr_storage *addr) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {buffer, len};
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(struct msghdr));
+    hdr.msg_name       = addr;
+    hdr.msg_namelen    = addr ? sizeof(struct sockaddr_storage) : 0;
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = control;
+    hdr.msg_controllen = sizeof(control);
+
+    ssize_t ret;
+    itb_ensure_nonblock((ret = recvmsg(sockfd, &hdr, MSG_DONTWAIT)) != -1);
+    if (ret == -1) {
+        return 0;
+    }
+
+    //no cmsg means the datagram was not coalesced
+    *segment = ret;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&hdr); cm; cm = CMSG_NXTHDR(&hdr, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cm), sizeof(int));
+            *segment = size;
+        }
+    }
+    return ret;
+}
+
+//==>sharded sockets<==
+int itb_attach_reuseport_cpu(int sfd, size_t total) {
+    //A = cpu; A %= total; return A
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, total},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {sizeof(code) / sizeof(code[0]), code};
+    return setsockopt(sfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+static void __itb_close_all(int *fds, size_t total) {
+    while (total) {
+        close(fds[--total]);
+    }
+}
+
+int itb_make_sharded_tcp(const char *port, int *fds, size_t total, bool steer_cpu) {
+    struct addrinfo hints;
+    struct addrinfo *result, *rp;
+    size_t made = 0;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family   = AF_UNSPEC; // Return IPv4 and IPv6 choices
+    hints.ai_socktype = SOCK_STREAM; // We want a TCP socket
+    hints.ai_flags    = AI_PASSIVE; // All interfaces
+
+    if (!total || getaddrinfo(NULL, port, &hints, &result)) {
+        return -1;
+    }
+
+    //the first address that binds is used for every shard
+    for (rp = result; rp != NULL && made < total; rp = rp->ai_next) {
+        for (; made < total; ++made) {
+            int sfd;
+            if ((sfd = socket(rp->ai_family, rp->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                     rp->ai_protocol))
+                == -1) {
+                break;
+            }
+
+            int enable = 1;
+            //group order follows listen order which is what the cpu program indexes
+            if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) == -1
+                || setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) == -1
+                || bind(sfd, rp->ai_addr, rp->ai_addrlen) == -1 || listen(sfd, SOMAXCONN) == -1) {
+                close(sfd);
+                break;
+            }
+            fds[made] = sfd;
+        }
+
+        if (made && made < total) {
+            //a later shard failed on an address the first one took
+            break;
+        }
+    }
+
+    freeaddrinfo(result);
+
+    if (made < total || (steer_cpu && itb_attach_reuseport_cpu(fds[0], total))) {
+        __itb_close_all(fds, made);
+        return -1;
+    }
+    return 0;
+}
+
+int itb_make_sharded_udp(int port, int *fds, size_t total, bool steer_cpu) {
+    struct sockaddr_in sin;
+    size_t made = 0;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port        = htons(port);
+    sin.sin_family      = AF_INET;
+
+    for (; made < total; ++made) {
+        int sfd;
+        if ((sfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+            break;
+        }
+
+        int enable = 1;
+        //udp joins the group on bind
+        if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) == -1
+            || setsockopt(sfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) == -1
+            || bind(sfd, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+            close(sfd);
+            break;
+        }
+        fds[made] = sfd;
+    }
+
+    if (!total || made < total || (steer_cpu && itb_attach_reuseport_cpu(fds[0], total))) {
+        __itb_close_all(fds, made);
+        return -1;
+    }
+    return 0;
+}
+
+int itb_pin_thread(int cpu) {
+    //cpu_set_t and pthread_setaffinity_np need _GNU_SOURCE, a tid of 0 is the calling thread
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+    if (cpu < 0 || (size_t)cpu >= sizeof(mask) * 8) {
+        return -1;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[cpu / (8 * sizeof(unsigned long))] |= 1UL << (cpu % (8 * sizeof(unsigned long)));
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) ? -1 : 0;
+}
+
+//==>epoll wrappers<==
+struct epoll_event *itb_make_epoll_events() {
+    return itb_make_epoll_events_n(ITB_MAXEVENTS);
+}
+
+struct epoll_event *itb_make_epoll_events_n(size_t total) {
+    return (struct epoll_event *)malloc(sizeof(struct epoll_event) * total);
+}
+
+int itb_make_epoll(void) {
+    int efd;
+    itb_ensure((efd = epoll_create1(EPOLL_CLOEXEC)) != -1);
+    return efd;
+}
+
+int itb_wait_epoll_n(int efd, struct epoll_event *restrict events, int total, int timeout) {
+    int ret;
+    if ((ret = epoll_wait(efd, events, total, timeout)) == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        return -1;
+    }
+    return ret;
+}
+
+int itb_wait_epoll(int efd, struct epoll_event *restrict events) {
+    return itb_wait_epoll_n(efd, events, ITB_MAXEVENTS, -1);
+}
+
+int itb_wait_epoll_timeout(int efd, struct epoll_event *restrict events, int timeout) {
+    int ret;
+    itb_ensure((ret = epoll_wait(efd, events, ITB_MAXEVENTS, timeout)) != -1);
+    return ret;
+}
+
+//the event lives on the callers stack so registering from several threads is safe
+static inline int __itb_epoll_ctl(int efd, int op, int ifd, epoll_data_t data, int flags) {
+    struct epoll_event event;
+    event.data   = data;
+    event.events = flags;
+    return epoll_ctl(efd, op, ifd, &event);
+}
+
+static inline int __itb_add_epoll(int efd, int ifd, epoll_data_t data, int flags) {
+    int ret;
+    itb_ensure((ret = __itb_epoll_ctl(efd, EPOLL_CTL_ADD, ifd, data, flags)) != -1);
+    return ret;
+}
+
+int itb_add_epoll_ptr(int efd, int ifd, void *ptr) {
+    return itb_add_epoll_ptr_flags(efd, ifd, ptr, EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE);
+}
+
+int itb_add_epoll_ptr_flags(int efd, int ifd, void *ptr, int flags) {
+    return __itb_add_epoll(efd, ifd, (epoll_data_t){.ptr = ptr}, flags);
+}
+
+int itb_add_epoll_fd(int efd, int ifd) {
+    return itb_add_epoll_fd_flags(efd, ifd, EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE);
+}
+
+int itb_add_epoll_fd_flags(int efd, int ifd, int flags) {
+    return __itb_add_epoll(efd, ifd, (epoll_data_t){.fd = ifd}, flags);
+}
+
+int itb_add_epoll_afd(int efd, int ifd, int dt) {
+    return itb_add_epoll_afd_flags(efd, ifd, dt, EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE);
+}
+
+int itb_add_epoll_afd_flags(int efd, int ifd, int dt, int flags) {
+    return __itb_add_epoll(efd, ifd, (epoll_data_t){.fd = dt}, flags);
+}
+
+int itb_mod_epoll_ptr_flags(int efd, int ifd, void *ptr, int flags) {
+    return __itb_epoll_ctl(efd, EPOLL_CTL_MOD, ifd, (epoll_data_t){.ptr = ptr}, flags);
+}
+
+int itb_mod_epoll_fd_flags(int efd, int ifd, int flags) {
+    return __itb_epoll_ctl(efd, EPOLL_CTL_MOD, ifd, (epoll_data_t){.fd = ifd}, flags);
+}
+
+int itb_mod_epoll_afd_flags(int efd, int ifd, int dt, int flags) {
+    return __itb_epoll_ctl(efd, EPOLL_CTL_MOD, ifd, (epoll_data_t){.fd = dt}, flags);
+}
+
+int itb_del_epoll(int efd, int ifd) {
+    //pre 2.6.9 kernels want a non NULL event even though it's ignored
+    struct epoll_event event;
+    return epoll_ctl(efd, EPOLL_CTL_DEL, ifd, &event);
+}
+
+//==>event loop<==
+static void __itb_loop_wake_read(itb_loop_t *loop, itb_loop_handler_t *handler, uint32_t events) {
+    (void)loop;
+    (void)events;
+    uint64_t value;
+    while (read(handler->fd, &value, sizeof(uint64_t)) == -1 && errno == EINTR) {
+    }
+}
+
+int itb_loop_init(itb_loop_t *loop, size_t total_events) {
+    memset(loop, 0, sizeof(itb_loop_t));
+    loop->total_events = total_events ? total_events : ITB_LOOP_EVENTS;
+    loop->now          = __itb_now_ms();
+
+    if ((loop->efd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        return -1;
+    }
+    if (!(loop->events = malloc(sizeof(struct epoll_event) * loop->total_events))) {
+        goto fail_epoll;
+    }
+    int wfd;
+    if ((wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        goto fail_events;
+    }
+    if (itb_loop_add(loop, &loop->wake, wfd, EPOLLIN, __itb_loop_wake_read, NULL)) {
+        close(wfd);
+        goto fail_events;
+    }
+    if (pthread_mutex_init(&loop->mut, NULL)) {
+        close(wfd);
+        goto fail_events;
+    }
+    return 0;
+
+fail_events:
+    free(loop->events);
+fail_epoll:
+    close(loop->efd);
+    return -1;
+}
+
+void itb_loop_close(itb_loop_t *loop) {
+    for (size_t i = 0; i < loop->total_timers; ++i) {
+        loop->timers[i]->index = SIZE_MAX;
+    }
+    close(loop->wake.fd);
+    close(loop->efd);
+    pthread_mutex_destroy(&loop->mut);
+    free(loop->events);
+    free(loop->timers);
+    free(loop->tasks);
+    free(loop->running);
+    memset(loop, 0, sizeof(itb_loop_t));
+    loop->efd = -1;
+}
+
+int itb_loop_add(itb_loop_t *loop, itb_loop_handler_t *handler, int fd, uint32_t events,
+    void (*func)(itb_loop_t *, itb_loop_handler_t *, uint32_t), void *data) {
+    handler->fd   = fd;
+    handler->func = func;
+    handler->data = data;
+    if (__itb_epoll_ctl(loop->efd, EPOLL_CTL_ADD, fd, (epoll_data_t){.ptr = handler}, events)) {
+        return -1;
+    }
+    return 0;
+}
+
+int itb_loop_modify(itb_loop_t *loop, itb_loop_handler_t *handler, uint32_t events) {
+    return itb_mod_epoll_ptr_flags(loop->efd, handler->fd, handler, events) ? -1 : 0;
+}
+
+int itb_loop_remove(itb_loop_t *loop, itb_loop_handler_t *handler) {
+    //events already returned for this pass may still name the handler
+    for (int i = 0; i < loop->pending; ++i) {
+        if (loop->events[i].data.ptr == handler) {
+            loop->events[i].data.ptr = NULL;
+        }
+    }
+    return itb_del_epoll(loop->efd, handler->fd) ? -1 : 0;
+}
+
+static inline void __itb_loop_timer_set(itb_loop_t *loop, size_t i, itb_loop_timer_t *timer) {
+    loop->timers[i] = timer;
+    timer->index    = i;
+}
+
+static void __itb_loop_timer_up(itb_loop_t *loop, size_t i) {
+    itb_loop_timer_t *timer = loop->timers[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (loop->timers[parent]->when <= timer->when) {
+            break;
+        }
+        __itb_loop_timer_set(loop, i, loop->timers[parent]);
+        i = parent;
+    }
+    __itb_loop_timer_set(loop, i, timer);
+}
+
+static void __itb_loop_timer_down(itb_loop_t *loop, size_t i) {
+    itb_loop_timer_t *timer = loop->timers[i];
+    for (;;) {
+        size_t child = i * 2 + 1;
+        if (child >= loop->total_timers) {
+            break;
+        }
+        if (child + 1 < loop->total_timers
+            && loop->timers[child + 1]->when < loop->timers[child]->when) {
+            ++child;
+        }
+        if (timer->when <= loop->timers[child]->when) {
+            break;
+        }
+        __itb_loop_timer_set(loop, i, loop->timers[child]);
+        i = child;
+    }
+    __itb_loop_timer_set(loop, i, timer);
+}
+
+void itb_loop_timer_init(itb_loop_timer_t *timer) {
+    memset(timer, 0, sizeof(itb_loop_timer_t));
+    timer->index = SIZE_MAX;
+}
+
+void itb_loop_timer_stop(itb_loop_t *loop, itb_loop_timer_t *timer) {
+    const size_t i = timer->index;
+    if (i == SIZE_MAX) {
+        return;
+    }
+    timer->index = SIZE_MAX;
+    if (i == --loop->total_timers) {
+        return;
+    }
+    //the last timer fills the hole and can belong either above or below it
+    itb_loop_timer_t *moved = loop->timers[loop->total_timers];
+    __itb_loop_timer_set(loop, i, moved);
+    __itb_loop_timer_up(loop, i);
+    __itb_loop_timer_down(loop, moved->index);
+}
+
+int itb_loop_timer_start(itb_loop_t *loop, itb_loop_timer_t *timer, int64_t ms,
+    void (*func)(itb_loop_t *, itb_loop_timer_t *), void *data) {
+    if (timer->index != SIZE_MAX) {
+        itb_loop_timer_stop(loop, timer);
+    }
+    if (loop->total_timers == loop->alloc_timers) {
+        size_t alloc = loop->alloc_timers ? loop->alloc_timers * 2 : 16;
+        itb_loop_timer_t **timers;
+        if (!(timers = realloc(loop->timers, alloc * sizeof(itb_loop_timer_t *)))) {
+            return -1;
+        }
+        loop->timers       = timers;
+        loop->alloc_timers = alloc;
+    }
+    timer->when = __itb_now_ms() + ms;
+    timer->func = func;
+    timer->data = data;
+    loop->timers[loop->total_timers] = timer;
+    __itb_loop_timer_up(loop, loop->total_timers++);
+    return 0;
+}
+
+void itb_loop_wake(itb_loop_t *loop) {
+    const uint64_t value = 1;
+    while (write(loop->wake.fd, &value, sizeof(uint64_t)) == -1 && errno == EINTR) {
+    }
+}
+
+int itb_loop_defer(itb_loop_t *loop, void (*func)(itb_loop_t *, void *), void *data) {
+    pthread_mutex_lock(&loop->mut);
+    if (loop->total_tasks == loop->alloc_tasks) {
+        size_t alloc = loop->alloc_tasks ? loop->alloc_tasks * 2 : 16;
+        itb_loop_task_t *tasks;
+        if (!(tasks = realloc(loop->tasks, alloc * sizeof(itb_loop_task_t)))) {
+            pthread_mutex_unlock(&loop->mut);
+            return -1;
+        }
+        loop->tasks       = tasks;
+        loop->alloc_tasks = alloc;
+    }
+    loop->tasks[loop->total_tasks].func = func;
+    loop->tasks[loop->total_tasks].data = data;
+    //only the first task since the last pass needs to wake the loop
+    const bool wake = loop->total_tasks++ == 0;
+    pthread_mutex_unlock(&loop->mut);
+
+    if (wake) {
+        itb_loop_wake(loop);
+    }
+    return 0;
+}
+
+void itb_loop_stop(itb_loop_t *loop) {
+    __atomic_store_n(&loop->stopping, true, __ATOMIC_RELEASE);
+    itb_loop_wake(loop);
+}
+
+static int __itb_loop_run_tasks(itb_loop_t *loop) {
+    pthread_mutex_lock(&loop->mut);
+    itb_loop_task_t *tasks = loop->tasks;
+    size_t total           = loop->total_tasks;
+    size_t alloc           = loop->alloc_tasks;
+    loop->tasks            = loop->running;
+    loop->alloc_tasks      = loop->alloc_running;
+    loop->total_tasks      = 0;
+    pthread_mutex_unlock(&loop->mut);
+
+    for (size_t i = 0; i < total; ++i) {
+        tasks[i].func(loop, tasks[i].data);
+    }
+
+    pthread_mutex_lock(&loop->mut);
+    loop->running       = tasks;
+    loop->alloc_running = alloc;
+    pthread_mutex_unlock(&loop->mut);
+    return total;
+}
+
+int itb_loop_run_once(itb_loop_t *loop, int timeout) {
+    int ran = 0;
+
+    //the wait is cut short by the first timer
+    loop->now = __itb_now_ms();
+    if (loop->total_timers) {
+        int64_t until = loop->timers[0]->when - loop->now;
+        if (until < 0) {
+            until = 0;
+        }
+        if (timeout < 0 || until < timeout) {
+            timeout = until > INT32_MAX ? INT32_MAX : until;
+        }
+    }
+
+    int total = epoll_wait(loop->efd, loop->events, loop->total_events, timeout);
+    if (total == -1 && errno != EINTR) {
+        return -1;
+    }
+    loop->pending = total;
+    for (int i = 0; i < total; ++i) {
+        itb_loop_handler_t *handler = loop->events[i].data.ptr;
+        //removed by an earlier handler this pass
+        if (!handler) {
+            continue;
+        }
+        handler->func(loop, handler, loop->events[i].events);
+        ++ran;
+    }
+    loop->pending = 0;
+
+    loop->now = __itb_now_ms();
+    while (loop->total_timers && loop->timers[0]->when <= loop->now) {
+        itb_loop_timer_t *timer = loop->timers[0];
+        itb_loop_timer_stop(loop, timer);
+        timer->func(loop, timer);
+        ++ran;
+    }
+
+    return ran + __itb_loop_run_tasks(loop);
+}
+
+int itb_loop_run(itb_loop_t *loop) {
+    while (!__atomic_load_n(&loop->stopping, __ATOMIC_ACQUIRE)) {
+        if (itb_loop_run_once(loop, -1) == -1) {
+            return -1;
+        }
+    }
+    __atomic_store_n(&loop->stopping, false, __ATOMIC_RELEASE);
+    return 0;
+}
+
+typedef struct {
+    itb_loop_t *loop;
+    void (*setup)(itb_loop_t *, size_t, void *);
+    void *data;
+    int ret;
+} __itb_loop_core_t;
+
+static void *__itb_loop_core(void *arg) {
+    __itb_loop_core_t *core = arg;
+    long cpus               = sysconf(_SC_NPROCESSORS_ONLN);
+    //pinning is best effort, cpusets may not allow every cpu
+    itb_pin_thread(core->loop->index % (cpus > 0 ? cpus : 1));
+    if (core->setup) {
+        core->setup(core->loop, core->loop->index, core->data);
+    }
+    core->ret = itb_loop_run(core->loop);
+    return NULL;
+}
+
+int itb_loop_run_cores(itb_loop_t *loops, size_t total,
+    void (*setup)(itb_loop_t *loop, size_t index, void *data), void *data) {
+    int ret = 0;
+    pthread_t *threads;
+    __itb_loop_core_t *cores;
+    if (!(threads = malloc(total * (sizeof(pthread_t) + sizeof(__itb_loop_core_t))))) {
+        return -1;
+    }
+    cores = (__itb_loop_core_t *)(threads + total);
+
+    size_t started = 0;
+    for (; started < total; ++started) {
+        loops[started].index = started;
+        cores[started].loop  = loops + started;
+        cores[started].setup = setup;
+        cores[started].data  = data;
+        cores[started].ret   = 0;
+        if (pthread_create(threads + started, NULL, __itb_loop_core, cores + started)) {
+            ret = -1;
+            break;
+        }
+    }
+    //a thread failed to start so the rest can't be left running forever
+    if (ret) {
+        for (size_t i = 0; i < started; ++i) {
+            itb_loop_stop(loops + i);
+        }
+    }
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+        ret |= cores[i].ret;
+    }
+    free(threads);
+    return ret;
+}
+
+//==>output queue<==
+void itb_outq_init(itb_outq_t *q, int fd) {
+    memset(q, 0, sizeof(itb_outq_t));
+    q->fd   = fd;
+    q->efd  = -1;
+    q->high = ITB_OUTQ_HIGH;
+    q->low  = ITB_OUTQ_LOW;
 }
-int itb_make_epoll(void) {
-    int efd;
-    itb_ensure((efd = epoll_create1(EPOLL_CLOEXEC)) != -1);
-    return efd;
+
+void itb_outq_close(itb_outq_t *q) {
+    itb_outq_chunk_t *chunk = q->head;
+    while (chunk) {
+        itb_outq_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(q->spare);
+    q->head = q->tail = q->spare = NULL;
+    q->queued                    = 0;
 }
 
-int itb_wait_epoll(int efd, struct epoll_event *restrict events) {
-    int ret;
-    if ((ret = epoll_wait(efd, events, ITB_MAXEVENTS, -1)) == -1) {
-        if (errno == EINTR) {
+void itb_outq_watch(itb_outq_t *q, int efd, epoll_data_t data, uint32_t events) {
+    q->efd        = efd;
+    q->epoll_data = data;
+    q->events     = events;
+    q->armed      = false;
+}
+
+static inline int __itb_outq_arm(itb_outq_t *q, bool arm) {
+    if (q->efd == -1 || q->armed == arm) {
+        return 0;
+    }
+    q->armed = arm;
+    return __itb_epoll_ctl(
+        q->efd, EPOLL_CTL_MOD, q->fd, q->epoll_data, q->events | (arm ? EPOLLOUT : 0));
+}
+
+static int __itb_outq_append(itb_outq_t *q, const uint8_t *buffer, size_t len) {
+    itb_outq_chunk_t *tail = q->tail;
+    //top up the tail first so small writes share chunks
+    if (tail && len <= ITB_OUTQ_COALESCE) {
+        size_t room = tail->size - tail->len;
+        size_t take = room < len ? room : len;
+        memcpy(tail->data + tail->len, buffer, take);
+        tail->len += take;
+        q->queued += take;
+        buffer += take;
+        len -= take;
+    }
+    if (!len) {
+        return 0;
+    }
+
+    itb_outq_chunk_t *chunk;
+    size_t size = len > ITB_OUTQ_CHUNK ? len : ITB_OUTQ_CHUNK;
+    if (q->spare && q->spare->size >= size) {
+        chunk    = q->spare;
+        q->spare = NULL;
+    } else if ((chunk = malloc(sizeof(itb_outq_chunk_t) + size))) {
+        chunk->size = size;
+    } else {
+        return -1;
+    }
+    chunk->next  = NULL;
+    chunk->start = 0;
+    chunk->len   = len;
+    memcpy(chunk->data, buffer, len);
+
+    if (q->tail) {
+        q->tail->next = chunk;
+    } else {
+        q->head = chunk;
+    }
+    q->tail = chunk;
+    q->queued += len;
+    return 0;
+}
+
+int itb_outq_write(itb_outq_t *q, const uint8_t *buffer, size_t len) {
+    //nothing to keep in order with so large writes skip the copy
+    if (!q->head && len > ITB_OUTQ_COALESCE) {
+        ssize_t ret;
+        do {
+            ret = send(q->fd, buffer, len, MSG_NOSIGNAL);
+        } while (ret == -1 && errno == EINTR);
+        if (ret == -1) {
+            if (errno != EAGAIN) {
+                return -1;
+            }
+            ret = 0;
+        }
+        buffer += ret;
+        len -= ret;
+        if (!len) {
             return 0;
         }
+        if (__itb_outq_append(q, buffer, len) || __itb_outq_arm(q, true)) {
+            return -1;
+        }
+    } else if (__itb_outq_append(q, buffer, len)) {
         return -1;
     }
-    return ret;
+
+    if (q->queued >= q->high) {
+        q->above_high = true;
+    }
+    return q->above_high;
 }
 
-int itb_wait_epoll_timeout(int efd, struct epoll_event *restrict events, int timeout) {
-    int ret;
-    itb_ensure((ret = epoll_wait(efd, events, ITB_MAXEVENTS, timeout)) != -1);
-    return ret;
+int itb_outq_flush(itb_outq_t *q) {
+    struct iovec iovs[ITB_OUTQ_IOV];
+
+    while (q->head) {
+        int total = 0;
+        for (itb_outq_chunk_t *chunk = q->head; chunk && total < ITB_OUTQ_IOV;
+             chunk = chunk->next) {
+            iovs[total].iov_base = chunk->data + chunk->start;
+            iovs[total].iov_len  = chunk->len - chunk->start;
+            ++total;
+        }
+
+        struct iovec *cursor = iovs;
+        int left             = total;
+        ssize_t sent         = itb_sendv(q->fd, &cursor, &left);
+        if (sent == -1) {
+            return -1;
+        }
+        q->queued -= sent;
+
+        //drop what fully went out, the cursor already knows where the partial one stopped
+        for (int i = 0; i < total - left; ++i) {
+            itb_outq_chunk_t *chunk = q->head;
+            q->head                 = chunk->next;
+            if (!q->spare && chunk->size == ITB_OUTQ_CHUNK) {
+                q->spare = chunk;
+            } else {
+                free(chunk);
+            }
+        }
+        if (!q->head) {
+            q->tail = NULL;
+        } else if (left) {
+            q->head->start = q->head->len - cursor->iov_len;
+        }
+        //the socket is full
+        if (left) {
+            break;
+        }
+    }
+
+    if (q->above_high && q->queued <= q->low) {
+        q->above_high = false;
+        if (q->on_low) {
+            q->on_low(q);
+        }
+    }
+    if (__itb_outq_arm(q, q->head != NULL)) {
+        return -1;
+    }
+    return q->head == NULL;
 }
 
-int itb_add_epoll_ptr(int efd, int ifd, void *ptr) {
-    int ret;
-    static struct epoll_event event;
-    event.data.ptr = ptr;
-    event.events   = EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
-    return ret;
+#ifdef ITB_URING
+//==>io_uring<==
+static inline int __itb_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return syscall(SYS_io_uring_setup, entries, params);
 }
 
-int itb_add_epoll_ptr_flags(int efd, int ifd, void *ptr, int flags) {
-    int ret;
-    static struct epoll_event event;
-    event.data.ptr = ptr;
-    event.events   = flags;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
-    return ret;
+static inline int __itb_uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return syscall(SYS_io_uring_enter, fd, submit, wait, flags, NULL, 0);
 }
 
-int itb_add_epoll_fd(int efd, int ifd) {
-    int ret;
-    static struct epoll_event event;
-    event.data.fd = ifd;
-    event.events  = EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
-    return ret;
+static inline int __itb_uring_register(int fd, unsigned opcode, const void *arg, unsigned total) {
+    return syscall(SYS_io_uring_register, fd, opcode, arg, total);
 }
 
-int itb_add_epoll_fd_flags(int efd, int ifd, int flags) {
-    int ret;
-    static struct epoll_event event;
-    event.data.fd = ifd;
-    event.events  = flags;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
-    return ret;
+int itb_uring_init(itb_uring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(struct io_uring_params));
+    memset(ring, 0, sizeof(itb_uring_t));
+
+    if ((ring->fd = __itb_uring_setup(entries ? entries : ITB_URING_ENTRIES, &params)) == -1) {
+        return -1;
+    }
+    ring->features = params.features;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    //both rings share one mapping on anything newer than 5.4
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        goto fail;
+    }
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes      = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    if (!(ring->timeouts = calloc(params.sq_entries, sizeof(struct __kernel_timespec)))) {
+        goto fail;
+    }
+
+    uint8_t *sq         = ring->sq_ring;
+    uint8_t *cq         = ring->cq_ring;
+    ring->sq_head       = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail       = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_array      = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_mask       = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_entries    = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->sq_submitted  = ring->sq_local_tail;
+    ring->cq_head       = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail       = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask       = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes          = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+
+fail:
+    itb_uring_close(ring);
+    return -1;
 }
 
-int itb_add_epoll_afd(int efd, int ifd, int dt) {
-    int ret;
-    static struct epoll_event event;
-    event.data.fd = dt;
-    event.events  = EPOLLOUT | EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
-    return ret;
+void itb_uring_close(itb_uring_t *ring) {
+    if (ring->buf_ring) {
+        munmap(ring->buf_ring, ring->buf_count * sizeof(struct io_uring_buf));
+        free(ring->bufs);
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    free(ring->timeouts);
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(itb_uring_t));
+    ring->fd = -1;
 }
 
-int itb_add_epoll_afd_flags(int efd, int ifd, int dt, int flags) {
+//a zeroed sqe with the common fields set or NULL if the queue is full
+static struct io_uring_sqe *__itb_uring_sqe(
+    itb_uring_t *ring, uint8_t opcode, int fd, void *data) {
+    const unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) {
+        return NULL;
+    }
+    const unsigned idx       = ring->sq_local_tail++ & ring->sq_mask;
+    struct io_uring_sqe *sqe = ring->sqes + idx;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode         = opcode;
+    sqe->fd             = fd;
+    sqe->user_data      = (uintptr_t)data;
+    ring->sq_array[idx] = idx;
+    return sqe;
+}
+
+int itb_uring_accept(itb_uring_t *ring, int sfd, bool multishot, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_ACCEPT, sfd, data))) {
+        return -1;
+    }
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    if (multishot) {
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+    }
+    return 0;
+}
+
+int itb_uring_connect(itb_uring_t *ring, int sfd, const struct sockaddr_storage *addr, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_CONNECT, sfd, data))) {
+        return -1;
+    }
+    sqe->addr = (uintptr_t)addr;
+    //connect takes the address length through off
+    sqe->off = addr->ss_family == AF_INET6 ? sizeof(struct sockaddr_in6)
+                                           : sizeof(struct sockaddr_in);
+    return 0;
+}
+
+int itb_uring_recv(itb_uring_t *ring, int sfd, uint8_t *buffer, size_t len, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_RECV, sfd, data))) {
+        return -1;
+    }
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len  = len;
+    return 0;
+}
+
+int itb_uring_send(itb_uring_t *ring, int sfd, const uint8_t *buffer, size_t len, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_SEND, sfd, data))) {
+        return -1;
+    }
+    sqe->addr      = (uintptr_t)buffer;
+    sqe->len       = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    return 0;
+}
+
+int itb_uring_timeout(itb_uring_t *ring, uint64_t ms, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_TIMEOUT, -1, data))) {
+        return -1;
+    }
+    struct __kernel_timespec *ts = ring->timeouts + (sqe - ring->sqes);
+    ts->tv_sec                   = ms / 1000;
+    ts->tv_nsec                  = (ms % 1000) * 1000000;
+    sqe->addr                    = (uintptr_t)ts;
+    sqe->len                     = 1;
+    return 0;
+}
+
+int itb_uring_register_buffers(itb_uring_t *ring, const struct iovec *iovs, unsigned total) {
+    return __itb_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iovs, total) ? -1 : 0;
+}
+
+int itb_uring_read_fixed(
+    itb_uring_t *ring, int fd, uint8_t *buffer, size_t len, unsigned index, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_READ_FIXED, fd, data))) {
+        return -1;
+    }
+    sqe->addr      = (uintptr_t)buffer;
+    sqe->len       = len;
+    sqe->buf_index = index;
+    //sockets have no position, -1 means the current one
+    sqe->off = -1;
+    return 0;
+}
+
+int itb_uring_write_fixed(
+    itb_uring_t *ring, int fd, const uint8_t *buffer, size_t len, unsigned index, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!(sqe = __itb_uring_sqe(ring, IORING_OP_WRITE_FIXED, fd, data))) {
+        return -1;
+    }
+    sqe->addr      = (uintptr_t)buffer;
+    sqe->len       = len;
+    sqe->buf_index = index;
+    sqe->off       = -1;
+    return 0;
+}
+
+//puts buffer bid at the ring tail, publish with the tail store
+static inline void __itb_uring_buffer_add(itb_uring_t *ring, uint16_t bid, unsigned offset) {
+    struct io_uring_buf *buf = ring->buf_ring->bufs
+                               + ((ring->buf_ring->tail + offset) & (ring->buf_count - 1));
+    buf->addr = (uintptr_t)(ring->bufs + (size_t)bid * ring->buf_size);
+    buf->len  = ring->buf_size;
+    buf->bid  = bid;
+}
+
+int itb_uring_provide_buffers(itb_uring_t *ring, unsigned count, unsigned size) {
+    if (!count || (count & (count - 1)) || count > 32768 || ring->buf_ring) {
+        return -1;
+    }
+
+    //the ring has to be page aligned so it comes straight from mmap
+    void *map = mmap(NULL, count * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    if (!(ring->bufs = malloc((size_t)count * size))) {
+        munmap(map, count * sizeof(struct io_uring_buf));
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+    reg.ring_addr    = (uintptr_t)map;
+    reg.ring_entries = count;
+    reg.bgid         = 0;
+    if (__itb_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+        munmap(map, count * sizeof(struct io_uring_buf));
+        free(ring->bufs);
+        ring->bufs = NULL;
+        return -1;
+    }
+
+    ring->buf_ring       = map;
+    ring->buf_count      = count;
+    ring->buf_size       = size;
+    ring->buf_ring->tail = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        __itb_uring_buffer_add(ring, i, i);
+    }
+    __atomic_store_n(&ring->buf_ring->tail, count, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int itb_uring_recv_multishot(itb_uring_t *ring, int sfd, void *data) {
+    struct io_uring_sqe *sqe;
+    if (!ring->buf_ring || !(sqe = __itb_uring_sqe(ring, IORING_OP_RECV, sfd, data))) {
+        return -1;
+    }
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->ioprio |= IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    return 0;
+}
+
+uint8_t *itb_uring_buffer(itb_uring_t *ring, const struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return NULL;
+    }
+    return ring->bufs + (size_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) * ring->buf_size;
+}
+
+void itb_uring_buffer_return(itb_uring_t *ring, const struct io_uring_cqe *cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        __itb_uring_buffer_add(ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT, 0);
+        __atomic_store_n(&ring->buf_ring->tail, ring->buf_ring->tail + 1, __ATOMIC_RELEASE);
+    }
+}
+
+int itb_uring_submit(itb_uring_t *ring, unsigned wait) {
+    const unsigned submit = ring->sq_local_tail - ring->sq_submitted;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
     int ret;
-    static struct epoll_event event;
-    event.data.fd = dt;
-    event.events  = flags;
-    itb_ensure((ret = epoll_ctl(efd, EPOLL_CTL_ADD, ifd, &event)) != -1);
+    do {
+        ret = __itb_uring_enter(ring->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == -1) {
+        return -errno;
+    }
+    ring->sq_submitted += ret;
     return ret;
 }
 
+struct io_uring_cqe *itb_uring_peek(itb_uring_t *ring) {
+    const unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return ring->cqes + (head & ring->cq_mask);
+}
+
+void itb_uring_seen(itb_uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+//==>async dns<==
+static itb_resolver_entry_t *__itb_resolver_slot(
+    itb_resolver_t *res, const char *host, int family) {
+    //fnv-1a
+    uint32_t hash = 2166136261u ^ (uint32_t)family;
+    for (const char *c = host; *c; ++c) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return res->cache + (hash & (ITB_RESOLVER_CACHE_SIZE - 1));
+}
+
+static void __itb_resolver_set_port(struct sockaddr_storage *addr, int port) {
+    if (addr->ss_family == AF_INET) {
+        ((struct sockaddr_in *)addr)->sin_port = htons(port);
+    } else if (addr->ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+    }
+}
+
+//must hold res->mut
+static bool __itb_resolver_lookup(itb_resolver_t *res, itb_resolve_req_t *req) {
+    itb_resolver_entry_t *entry = __itb_resolver_slot(res, req->host, req->family);
+    if (entry->expires > __itb_now_ms() && entry->family == req->family
+        && !strcmp(entry->host, req->host)) {
+        req->status   = 0;
+        req->addr_len = entry->addr_len;
+        memcpy(&req->addr, &entry->addr, entry->addr_len);
+        __itb_resolver_set_port(&req->addr, req->port);
+        return true;
+    }
+    return false;
+}
+
+//fills in status and addr, does not touch the cache
+static void __itb_resolver_resolve(itb_resolve_req_t *req) {
+    struct addrinfo hints;
+    struct addrinfo *rp;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_family   = req->family;
+    hints.ai_socktype = SOCK_STREAM; //one result per address
+
+    //assuming the first result returned will be correct like itb_make_storage
+    if (!(req->status = getaddrinfo(req->host, NULL, &hints, &rp))) {
+        req->addr_len = rp->ai_addrlen;
+        memcpy(&req->addr, rp->ai_addr, rp->ai_addrlen);
+        freeaddrinfo(rp);
+    }
+}
+
+//must hold res->mut
+static void __itb_resolver_store(itb_resolver_t *res, const itb_resolve_req_t *req) {
+    if (req->status || strlen(req->host) >= sizeof(((itb_resolver_entry_t *)0)->host)) {
+        return;
+    }
+    itb_resolver_entry_t *entry = __itb_resolver_slot(res, req->host, req->family);
+    strcpy(entry->host, req->host);
+    entry->family   = req->family;
+    entry->expires  = __itb_now_ms() + res->ttl_ms;
+    entry->addr_len = req->addr_len;
+    memcpy(&entry->addr, &req->addr, req->addr_len);
+}
+
+static void *__itb_resolver_worker(void *arg) {
+    itb_resolver_t *res = (itb_resolver_t *)arg;
+    const uint64_t one  = 1;
+
+    pthread_mutex_lock(&res->mut);
+    while (1) {
+        while (!res->pending_head && !res->closing) {
+            pthread_cond_wait(&res->cond, &res->mut);
+        }
+        if (res->closing) {
+            break;
+        }
+
+        itb_resolve_req_t *req = res->pending_head;
+        if (!(res->pending_head = req->next)) {
+            res->pending_tail = NULL;
+        }
+
+        //an earlier worker may have finished the same host while this sat in the queue
+        if (!__itb_resolver_lookup(res, req)) {
+            pthread_mutex_unlock(&res->mut);
+            __itb_resolver_resolve(req);
+            pthread_mutex_lock(&res->mut);
+            __itb_resolver_store(res, req);
+            __itb_resolver_set_port(&req->addr, req->port);
+        }
+
+        req->next = res->done;
+        res->done = req;
+        itb_ensure(write(res->efd, &one, sizeof(one)) == sizeof(one));
+    }
+    pthread_mutex_unlock(&res->mut);
+    return NULL;
+}
+
+int itb_resolver_init(itb_resolver_t *res, size_t workers, int ttl_ms) {
+    memset(res, 0, sizeof(itb_resolver_t));
+    if (!workers || workers > ITB_RESOLVER_MAX_WORKERS) {
+        return -1;
+    }
+
+    if ((res->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        return -1;
+    }
+
+    if (!(res->cache = calloc(ITB_RESOLVER_CACHE_SIZE, sizeof(itb_resolver_entry_t)))) {
+        close(res->efd);
+        return -1;
+    }
+
+    res->ttl_ms = ttl_ms;
+    pthread_mutex_init(&res->mut, NULL);
+    pthread_cond_init(&res->cond, NULL);
+
+    for (; res->total_workers < workers; ++res->total_workers) {
+        if (pthread_create(res->workers + res->total_workers, NULL, __itb_resolver_worker, res)) {
+            itb_resolver_close(res);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void itb_resolver_close(itb_resolver_t *res) {
+    pthread_mutex_lock(&res->mut);
+    res->closing = true;
+    pthread_cond_broadcast(&res->cond);
+    pthread_mutex_unlock(&res->mut);
+
+    //a worker stuck in getaddrinfo holds this up until it returns
+    for (size_t i = 0; i < res->total_workers; ++i) {
+        pthread_join(res->workers[i], NULL);
+    }
+
+    pthread_mutex_destroy(&res->mut);
+    pthread_cond_destroy(&res->cond);
+    close(res->efd);
+    free(res->cache);
+    memset(res, 0, sizeof(itb_resolver_t));
+    res->efd = -1;
+}
+
+int itb_resolve_async(itb_resolver_t *res, itb_resolve_req_t *req) {
+    req->next = NULL;
+
+    pthread_mutex_lock(&res->mut);
+    if (__itb_resolver_lookup(res, req)) {
+        pthread_mutex_unlock(&res->mut);
+        return 1;
+    }
+    if (res->closing) {
+        pthread_mutex_unlock(&res->mut);
+        return -1;
+    }
+
+    if (res->pending_tail) {
+        res->pending_tail->next = req;
+    } else {
+        res->pending_head = req;
+    }
+    res->pending_tail = req;
+
+    pthread_cond_signal(&res->cond);
+    pthread_mutex_unlock(&res->mut);
+    return 0;
+}
+
+itb_resolve_req_t *itb_resolver_completed(itb_resolver_t *res) {
+    uint64_t count;
+    //reset the eventfd before taking the list so nothing completed after is missed
+    itb_ensure_nonblock(read(res->efd, &count, sizeof(count)) != -1);
+
+    pthread_mutex_lock(&res->mut);
+    itb_resolve_req_t *done = res->done;
+    res->done               = NULL;
+    pthread_mutex_unlock(&res->mut);
+
+    return done;
+}
+
+int itb_make_storage_cached(
+    itb_resolver_t *res, struct sockaddr_storage *addr, const char *host, int port) {
+    itb_resolve_req_t req;
+    memset(&req, 0, sizeof(itb_resolve_req_t));
+    req.host   = host;
+    req.port   = port;
+    req.family = AF_UNSPEC;
+
+    pthread_mutex_lock(&res->mut);
+    bool hit = __itb_resolver_lookup(res, &req);
+    pthread_mutex_unlock(&res->mut);
+
+    if (!hit) {
+        __itb_resolver_resolve(&req);
+
+        pthread_mutex_lock(&res->mut);
+        __itb_resolver_store(res, &req);
+        pthread_mutex_unlock(&res->mut);
+
+        __itb_resolver_set_port(&req.addr, port);
+    }
+
+    if (!req.status) {
+        memcpy(addr, &req.addr, req.addr_len);
+    }
+    return req.status;
+}
+
+#ifdef ITB_H
+int itb_strbuf_append_addr(itb_strbuf_t *sb, const struct sockaddr_storage *addr) {
+    const void *src;
+    in_port_t port;
+    bool v6 = false;
+    if (addr->ss_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+        src  = &in->sin_addr;
+        port = in->sin_port;
+    } else if (addr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+        src  = &in6->sin6_addr;
+        port = in6->sin6_port;
+        v6   = true;
+    } else {
+        return -1;
+    }
+
+    //brackets, ':' and the port all fit in the slack of INET6_ADDRSTRLEN
+    if (itb_strbuf_reserve(sb, INET6_ADDRSTRLEN + ITB_FMT_INT_MAX)) {
+        return -1;
+    }
+
+    char *out = sb->data + sb->len;
+    if (v6) {
+        *out++ = '[';
+    }
+    if (!inet_ntop(addr->ss_family, src, out, INET6_ADDRSTRLEN)) {
+        return -1;
+    }
+    out += strlen(out);
+    if (v6) {
+        *out++ = ']';
+    }
+    *out++ = ':';
+    out += itb_fmt_u64(out, ntohs(port));
+
+    sb->len = out - sb->data;
+    return 0;
+}
+#endif
+
 #ifdef ITB_SSL_ADDITIONS
 
 int itb_ssl_init(itb_ssl_conn_t *conn, const char *host) {
@@ -169,6 +169,8 @@ typedef struct itb_ui_context {
     itb_color_mode * color_buffer[2];
     //[row * col]
     ITB_CHAR * buffer[2];
+    //[col + 1] scratch line for formatting
+    ITB_CHAR * line;
     //current painting color
     itb_color_mode current_color;
     //last painted color
@@ -366,12 +368,14 @@ int itb_ui_start(itb_ui_context * ITB_RESTRICT ctx) {
     uint8_t * data1_offset = (temp + data_size);
     uint8_t * color0_offset = (temp + data_size * 2);
     uint8_t * color1_offset = (temp + data_size * 2 + color_size);
+    uint8_t * line_offset = (temp + (data_size + color_size) * 2);
 
     //fill out the structure
     ctx->buffer[0] = (ITB_CHAR *)data0_offset;
     ctx->buffer[1] = (ITB_CHAR *)data1_offset;
     ctx->color_buffer[0] = (itb_color_mode *)color0_offset;
     ctx->color_buffer[1] = (itb_color_mode *)color1_offset;
+    ctx->line = (ITB_CHAR *)line_offset;
 
     //clear everything and move to the top left
     ITB_FPRINTF(stdout, ITB_T("\x1b[2J\x1b[H"));
@@ -442,11 +446,10 @@ int itb_ui_printf(
         int ret;
         va_start(args, fmt);
 
-        //+1 for NULL terminator
+        //format into the render line, +1 for NULL terminator
         const size_t maxlen = ctx->cols - col + 1;
-        ITB_CHAR tbuf[maxlen];
 
-        ret = ITB_SPRINTF(tbuf, maxlen, fmt, args);
+        ret = ITB_SPRINTF(ctx->line, maxlen + 1, fmt, args);
 
         if (ret > 0) {
             if ((size_t)ret > maxlen) {
@@ -456,7 +459,7 @@ int itb_ui_printf(
             ITB_UI_RC_IDX(ctx, row, col, idx);
 
             //characters
-            ITB_MEMCPY(ctx->buffer[0] + idx, tbuf, ret);
+            ITB_MEMCPY(ctx->buffer[0] + idx, ctx->line, ret);
             //color
             for (size_t i = 0; i < (size_t)ret; ++i) {
                 ctx->color_buffer[0][idx + i].flags = ctx->current_color.flags;